@@ -9,6 +9,7 @@
 ;					 Added bank switch helpers and 6MB mode handling
 ; Rev: 30 Jul 2009 - Fixed timeout loops from dbra to regular count so they aren't limited to 16-bits!
 ; Rev: 21 Sep 2020 - Fixed skunkFILEREAD return value to fill entire d0 long word.
+; Rev: 16 Oct 2026 - Added the mailbox, skunkMBOXPOST and skunkMBOXPING
 ; 
 ; This file is licensed freely and may be used for any purpose, commercial or
 ; otherwise, without notice or compensation.
@@ -95,6 +96,21 @@
 ; skunkFILECLOSE()
 ; Instructs the currently open file to close. No arguments.
 ;
+; skunkMBOXPOST(a0,d0)
+; Posts a short message to the PC through the mailbox, it is printed
+; there in hex: flags, counters... Needs JCP 2.09 or later.
+; a0 - address of the data
+; d0 - number of bytes, up to 16 (must be even)
+; The PC reads 16 bytes instead of a whole buffer, a lot quicker than
+; a console write. Waits (with timeout) for the previous message to be
+; read, but not for this one.
+;
+; d0=skunkMBOXPING(a0,d0)
+; Sends d0 bytes (up to 16, even) at a0 through the mailbox, the PC
+; sends them back into the same buffer. d0 returns the length of the
+; answer, 0 on timeout. A round trip takes a fraction of a console
+; write, handy to measure the link or to check the PC is there.
+;
 ;---------------------------------------------------------------------
 
 	.extern skunkRESET
@@ -107,12 +123,23 @@
 	.extern skunkFILEWRITE
 	.extern skunkFILEREAD
 	.extern skunkFILECLOSE
+	.extern skunkMBOXPOST
+	.extern skunkMBOXPING
 
 ;---------------------------------------------------------------------
 		.long
 
 timeout	.equ	200000
 
+; the mailbox, in the free EZ-HOST RAM after the buffers: a slot each way,
+; 16 bytes of data then a control word, type in the high byte and length in
+; the low one, $FFFF when free
+mboxJag		.equ	$3800		; Jag to PC
+mboxPC		.equ	$3820		; PC to Jag, the answers
+mboxCtrl	.equ	$10
+mboxPING	.equ	$0100
+mboxPOST	.equ	$0200
+
 ; skunkRESET()
 ; Resets the library, waits for the PC, and marks the console up or down
 skunkRESET::
@@ -506,6 +533,83 @@ skunkFILECLOSE::
 		movem.l (sp)+,d1/a1-a2		; Restore regs
 		rts
 		
+; skunkMBOXPOST(a0,d0)
+; Posts up to 16 bytes to the PC through the mailbox
+skunkMBOXPOST::
+		movem.l	d0-d2/a0-a3,-(sp)
+
+		move.w	#mboxPOST,d2		; message type
+		bsr		mboxSend			; no answer to wait for
+
+		bsr		restoreMode			; set correct flash mode
+		movem.l (sp)+,d0-d2/a0-a3	; Restore regs
+		rts
+
+; d0=skunkMBOXPING(a0,d0)
+; Sends up to 16 bytes to the PC through the mailbox, and reads them back
+skunkMBOXPING::
+		movem.l	d1-d2/a0-a3,-(sp)
+
+		bsr		setAddresses		; get HPI addresses into a1 & a2
+		tst.l	skunkConsoleUp
+		beq		.send				; no console, mboxSend gives up
+
+		; drop an answer left by a ping that timed out, the PC only
+		; answers into a free slot - before the ping, not to lose its answer
+		move.w	#$4004,(a1)			; enter HPI write mode
+		move.w	#(mboxPC+mboxCtrl),(a1)	; set HPI write data address
+		move.w	#$FFFF,(a2)			; write data
+		move.w	#$4001,(a1)			; enter flash read-only mode
+
+.send:
+		move.w	#mboxPING,d2		; message type
+		bsr		mboxSend			; returns 0 in d1 if it couldn't
+		clr.l	d0					; nothing back yet
+		tst.l	d1
+		beq		.exit
+
+		; wait for the answer
+		move.l	#timeout,d1
+.inploop:
+		move.w	#(mboxPC+mboxCtrl),(a1)	; write address
+		move.w	(a1),d2				; read data
+		andi.w	#$FF00,d2
+		cmp.w	#$FF00,d2			; test if used
+		bne		.gotresp
+		subq.l	#1,d1
+		bne		.inploop
+		; got nothing, give up
+		bra		.exit
+
+.gotresp:
+		; get the real value again, the high byte can come first
+		move.w	#(mboxPC+mboxCtrl),(a1)	; write address
+		move.w	(a1),d2				; read data
+		move.b	d2,d0				; length of the answer
+		cmp.w	#16,d0
+		bls		.lenok
+		moveq	#16,d0				; no more than the slot
+.lenok:
+		move.l	d0,d1
+		addq.l	#1,d1				; so we don't lose a byte
+		lsr.l	d1					; divide by two for words
+		move.w	#mboxPC,(a1)		; set address
+		bra		.cpnext
+.cplp:
+		move.w	(a1),(a0)+			; read data
+.cpnext:
+		dbra	d1,.cplp
+
+		; free the slot for the next answer
+		move.w	#$4004,(a1)			; enter HPI write mode
+		move.w	#(mboxPC+mboxCtrl),(a1)	; set HPI write data address
+		move.w	#$FFFF,(a2)			; write data
+
+.exit:
+		bsr		restoreMode			; set correct flash mode
+		movem.l (sp)+,d1-d2/a0-a3	; Restore regs
+		rts
+		
 ; ---------------------------------------------------------------------
 ; Helper functions - not intended to be externally called
 ; ---------------------------------------------------------------------
@@ -646,6 +750,50 @@ waitforbufferack:
 		movem.l	(sp)+,d0-d2
 		rts
 
+; mboxSend - sends the d0 bytes at a0 (up to 16) through the mailbox, as
+; a message of type d2. Waits for the slot to be free, returns 0 in d1 if it
+; stays busy. Calls setAddresses, leaves flash read-only mode set.
+mboxSend:
+		bsr		setAddresses		; get HPI addresses into a1 & a2
+		move.l	a0,a3				; the caller's a0 is kept
+		tst.l	skunkConsoleUp
+		beq		.busy				; no console, nobody reads the mailbox
+
+		move.l	#timeout,d1
+.waitlp:
+		move.w	#(mboxJag+mboxCtrl),(a1)	; set read address
+		cmp.w	#$FFFF,(a1)			; is the slot free?
+		beq		.free
+		subq.l	#1,d1
+		bne		.waitlp
+.busy:
+		clr.l	d1					; slot busy, or no console
+		rts
+
+.free:
+		cmp.l	#16,d0
+		bls		.lenok
+		moveq	#16,d0				; no more than the slot
+.lenok:
+		move.w	#$4004,(a1)			; enter HPI write mode
+		move.w	#mboxJag,(a1)		; set HPI write data address
+		move.l	d0,d1
+		addq.l	#1,d1				; for the divide about to come
+		lsr.l	d1					; divide by two to get word count
+		bra		.wrnext
+.wrlp:
+		move.w	(a3)+,(a2)			; write data
+.wrnext:
+		dbra	d1,.wrlp
+
+		move.w	#(mboxJag+mboxCtrl),(a1)	; set address
+		move.w	d0,d1
+		or.w	d2,d1				; type and length
+		move.w	d1,(a2)				; write it (PC gets the message now)
+		move.w	#$4001,(a1)			; enter flash read-only mode
+		moveq	#-1,d1				; sent
+		rts
+
 		.bss
 		.long
 
@@ -0,0 +1,61 @@
+//
+// BSS clearing stub, hand assembled - position independent, loaded along
+// with the list of ranges it is followed by, and started there
+//
+// Clears each range of the list, a start and a length in bytes (0 ends the
+// list), a byte first if the start is odd, then by longs, then the bytes
+// left. Then it starts the program at entry, with the status register it
+// was started with. The host patches entry at BSSSTUB_ENTRY, and places
+// the stub and its list above the image (see jcp_bss.c).
+//
+//  +00  40E7             	move.w	sr,-(sp)
+//  +02  46FC 2700        	move.w	#$2700,sr		; no interrupts
+//  +06  41FA 003A        	lea	ranges(pc),a0
+//  .next:
+//  +0A  2258             	movea.l	(a0)+,a1		; start
+//  +0C  2018             	move.l	(a0)+,d0		; length, 0 ends the list
+//  +0E  6726             	beq.s	.done
+//  +10  2209             	move.l	a1,d1
+//  +12  0801 0000        	btst	#0,d1
+//  +16  6704             	beq.s	.even
+//  +18  4219             	clr.b	(a1)+			; odd start
+//  +1A  5380             	subq.l	#1,d0
+//  .even:
+//  +1C  2200             	move.l	d0,d1
+//  +1E  E488             	lsr.l	#2,d0
+//  +20  6706             	beq.s	.bytes
+//  .longs:
+//  +22  4299             	clr.l	(a1)+
+//  +24  5380             	subq.l	#1,d0
+//  +26  66FA             	bne.s	.longs
+//  .bytes:
+//  +28  0241 0003        	andi.w	#3,d1
+//  +2C  67DC             	beq.s	.next
+//  .byte:
+//  +2E  4219             	clr.b	(a1)+
+//  +30  5341             	subq.w	#1,d1
+//  +32  66FA             	bne.s	.byte
+//  +34  60D4             	bra.s	.next
+//  .done:
+//  +36  46DF             	move.w	(sp)+,sr
+//  +38  207A 0004        	movea.l	entry(pc),a0
+//  +3C  4ED0             	jmp	(a0)
+//  entry:
+//  +3E  0000 4000        	dc.l	$4000
+//  ranges:
+//  +42
+//
+
+unsigned char BSSSTUB[] = {
+	0x40,0xE7,0x46,0xFC,0x27,0x00,0x41,0xFA,0x00,0x3A,0x22,0x58,0x20,0x18,0x67,0x26,	// @.F.'.A..:"X .g& //
+	0x22,0x09,0x08,0x01,0x00,0x00,0x67,0x04,0x42,0x19,0x53,0x80,0x22,0x00,0xE4,0x88,	// ".....g.B.S."... //
+	0x67,0x06,0x42,0x99,0x53,0x80,0x66,0xFA,0x02,0x41,0x00,0x03,0x67,0xDC,0x42,0x19,	// g.B.S.f..A..g.B. //
+	0x53,0x41,0x66,0xFA,0x60,0xD4,0x46,0xDF,0x20,0x7A,0x00,0x04,0x4E,0xD0,0x00,0x00,	// SAf.`.F. z..N... //
+	0x40,0x00,                                                                      	// @.               //
+};
+
+// Size of data in above array
+#define SIZE_OF_BSSSTUB 66
+
+// Offset of the parameter in the array, the list of ranges follows it
+#define BSSSTUB_ENTRY		0x3E		// long, where the program is started
@@ -15,9 +15,12 @@ Memory map relative to base address $2800:
 			The 68K sets this at $2800 and $1800 before transfer begins
 			After each block is moved, the 68K sets this to -1 again. Some
 			sequences are bi-directional.
+	$37EC:	Block serial number, left by jcp2 and not read by the 68K, it
+			tells a block from the one before at the same base (see jcp_resume.c)
 
 	Note:   the values FxFF, excluding FFFF, are reserved as flag values
-			for future, incompatible versions of JCP, to allow detection.
+			for future, incompatible versions of JCP, to allow detection:
+			FnFF is a BIOS speaking the protocol level n+1 (see jcp_caps.c)
 
 	OTG has 16k of internal RAM:
 	0000 - 04A3 - Interrupt vectors, HW Registers and USB buffers
@@ -26,7 +29,8 @@ Memory map relative to base address $2800:
 	102C - 17FF - Free
 	1800 - 27FF - Transmit buffer 1
 	2800 - 37FF - Transmit buffer 2
-	3800 - 3FFF - Free
+	3800 - 3833 - Console mailbox (see jcp_mbox.h)
+	3834 - 3FFF - Free
 	4000 - BFFF - external memory (not implemented)
 	C000 - C0FF - control registers
 	C100 - DFFF - external memory (not implemented)
@@ -48,6 +52,37 @@ Observations:
 		This applies even with escaping!  (Which makes 9120 bytes...)
 	 Roundtrips hurt -- compare 10 seconds/megabyte @ 4080 to 13 seconds/megabyte @ 2048
 	 We currently use 'middle endian' because the CPLD does not byteswap 'data regions'
+	 With libusb 1.0, uploads are pipelined: while one buffer is being drained by the
+		68K, the next block is already swapped and queued behind it (see WriteABlock)
+	 The upload blocks are byte swapped straight from the input into the transport
+		block (see SendFile and jcp_swap.c), the image is not copied on the side
+	 Compressed uploads (--rle) send a RAM image as a run length stream, behind a
+		hand assembled decompressor stub (rlestub.h) which expands it and starts
+		it (see jcp_rle.c). Run length rather than LZ: the stub stays at 62 bytes
+		and its listing can be checked by hand, and the zeros of BSS and padding
+		are most of what compresses. Flash uploads are not compressed, the flash
+		stub hands the programming to the BIOS flash code, which only reads blocks
+	 The flash checksum stub (--verify) is hand assembled too, its listing is in
+		verifystub.h. It sums the flash per 64k block, which the 68K does for 4MB
+		in about 2 seconds, a CRC-32 would take some 20
+	 Erasing a sector while the previous one is programmed was looked at too: the flash
+		stub hands the whole job to the flash code of the BIOS (jumps to [$800804]),
+		which erases the blocks first, then programs. Interleaving them takes a new
+		stub driving the flash chip itself, which can't be tried here without a board,
+		and a wrong one may erase the BIOS. What is overlapped with the erase is the
+		upload preparation (jcp_prep.c), and the erase is kept to the blocks the
+		image covers (jcp_erase.c)
+	 The same goes for a 6MB flash in a single pass: the flash stub is only the
+		block count and flags written to $3FF0 (and its check to $3FF4), and a
+		jump to the BIOS flash code. That code picks the bank once, erases, then
+		programs what its reader loop gets until a start address comes. Both
+		banks in one load takes that flash code rewritten, so 6MB mode stays
+		two stub loads, one per bank (HandleSixMegTransfer)
+	 More than two transfer buffers were looked at, in the free 102C-17FF and 3800-3FFF:
+		neither holds a block, the trailer is at +FE0 and 3800+FE0 is past the end of
+		the OTG RAM, and the reader that follows the $37E8 chain is the BIOS one, in
+		the board flash. Half size blocks would fit, at the cost of twice the round
+		trips (see above). The poll latency is hidden by the pipelined uploads instead
 
 Lots and lots of tweaks by Tursi, sorry, not all documented, though I've updated what
 I changed above.
@@ -85,6 +120,7 @@ Additional coding by Dilinger @ AA (2014-2020), no Copyright has been broken.
 #endif
 #include <errno.h>
 #include <time.h>
+#include <setjmp.h>
 #if defined(WIN32) || defined(WIN64)
 #include <process.h>
 #ifdef LIBUSB_1
@@ -94,16 +130,35 @@ Additional coding by Dilinger @ AA (2014-2020), no Copyright has been broken.
 #endif
 #else
 #include <unistd.h>
+#ifdef LIBUSB_1
+#include <libusb-1.0/libusb.h>
+#else
 #include <usb.h>
+#endif
 #include <sys/time.h>
 #endif
-#include "turbow.h"
+#include "jcp2.h"
+#include "jcp_transport.h"
+#include "jcp_daemon.h"
+#include "jcp_swap.h"
+#include "jcp_delta.h"
+#include "jcp_input.h"
+#include "jcp_prep.h"
+#include "jcp_poll.h"
+#include "jcp_resume.h"
+#include "jcp_erase.h"
+#include "jcp_mbox.h"
+#include "jcp_caps.h"
+#include "jcp_rle.h"
+#include "jcp_bss.h"
+#include "jcp_crc.h"
 #include "univbin.h"
 #include "romdump.h"
 #include "flashstub.h"
 #include "dumpver.h"
 #include "standard_values.h"
 #include "readver.h"
+#include "verifystub.h"
 #ifdef INCLUDE_BIOS_10204
 #include "upgrade10204.h"
 #endif
@@ -132,14 +187,20 @@ Additional coding by Dilinger @ AA (2014-2020), no Copyright has been broken.
 #endif
 
 /* version major.minor.rev */
-#define JCP2VERSION 0x020800
-#define	JCP2_VERSION	"2.08.00"
+#define JCP2VERSION 0x020900
+#define	JCP2_VERSION	"2.09.00"
 /* ROM based address that we can blindly send dummy data to */
 #define DUMMYBASE 0xFFE000
-/* size of the work buffer (maximum ROM size plus slack) */
+/* largest input file (maximum ROM size plus slack) */
 #define BUFSIZE (6*1024*1024+0x2000)
+/* bytes of a pipe read before looking for a file header */
+#define STREAMHEAD 0x4000
 /* size of a RAM buffer (for ELF file loading) */
 #define RAMBUFSIZE (2*1024*1024)
+/* a block read back corrupted is sent again that many times (--check) */
+#define CHECK_TRIES 3
+/* the Jag is given up if the BIOS is not back that long after a reset */
+#define RESET_TIMEOUTMS 15000
 
 #define	ENBIGEND(_x) (((_x)[0] << 24) + ((_x)[1] << 16) + ((_x)[2] << 8) + (_x)[3])
 #define	HALFBIGEND(_x) (((_x)[0] << 8) + (_x)[1])
@@ -183,26 +244,7 @@ int nDigits[12][7] = {
 	{ 15,15,15,15,15,15,6 }
 };
 
-#ifndef uchar
-#define uchar unsigned char
-#endif
-#ifndef bool
-#define bool int
-#endif
-#ifndef true
-#define true 1
-#endif
-#ifndef false
-#define false 0
-#endif
-
 #if !defined(WIN32) && !defined(WIN64)
-/* linux compatibility with Windows terms */
-#define DWORD unsigned int
-#define _stricmp strcasecmp
-#define Sleep(x) usleep(x*1000)
-#define _execlp execlp
-
 /* returns a count in ms - this one should be osx compat */
 DWORD GetTickCount() {
 	struct timeval now;
@@ -219,22 +261,66 @@ DWORD GetTickCount() {
 }
 #endif
 
-#ifdef LIBUSB_1
-libusb_device_handle *findEZ(bool fInstallTurboW, bool fAbortOnFail);
+/* returns a count in microseconds */
+unsigned long long GetMicroCount(void)
+{
+#if defined(WIN32) || defined(WIN64)
+	LARGE_INTEGER freq, now;
+
+	if (!QueryPerformanceFrequency(&freq) || !QueryPerformanceCounter(&now))
+	{
+		return (unsigned long long)GetTickCount() * 1000;
+	}
+
+	return (unsigned long long)((now.QuadPart / freq.QuadPart) * 1000000 + ((now.QuadPart % freq.QuadPart) * 1000000) / freq.QuadPart);
 #else
-usb_dev_handle *findEZ(bool fInstallTurboW, bool fAbortOnFail);
+	struct timeval now;
+
+	if (gettimeofday(&now, NULL) != 0)
+	{
+		return 0;	/* we got nothing */
+	}
+
+	return (unsigned long long)now.tv_sec * 1000000 + now.tv_usec;
 #endif
-void Reattach(void);
-void bye(char* msg);
-void SendFile(int flen, uchar *fptr, int curbase, int base);
-int  DoFile(uchar *fdata, int base, int flen, int skip, bool builtin);
+}
+
+bool findEZ(bool fInstallTurboW, bool fAbortOnFail);
+void SendFile(const IMAGEINFO *pImage);
+int  SendStream(const IMAGEINFO *pImage);
+int  LastBlockStart(int base);
+void EndUpload(void);
+bool StreamImage(IMAGEINFO *pImage);
+bool AddSegment(IMAGEINFO *pImage, int base, uchar *pData, int nLen, int nZero);
+void ImageFromRange(IMAGEINFO *pImage, uchar *fdata, int base, int flen, int skip);
+int  DoFile(uchar *fdata, int base, int flen, int skip);
+int  DoImage(const IMAGEINFO *pImage);
+int  SixMegTrim(IMAGEINFO *pImage);
 void LockBothBuffers(void);
 bool TestIfBuffersLocked(void);
-void WaitForBothBuffers(void);
+void ResetIfNotInBios(void);
+void WaitForBothBuffers(int nHintMs);
+bool PollIsBooted(unsigned short nWord);
+bool PollIsVerified(unsigned short nWord);
+void WriteCheckedBlock(int ez, uchar *block);
+int  WaitForReady(unsigned long long tReset);
 void DoResetAndReconnect(bool bForce);
 void DoResetAndBoot(void);
-void DoFlash(int nLen);
+void DoFlash(const IMAGEINFO *pImage);
+void DoFlashBlocks(unsigned int nBlocks);
+int HandleDeltaTransfer(const IMAGEINFO *pImage);
+int HandleRleTransfer(const IMAGEINFO *pImage);
+int HandleBssTransfer(const IMAGEINFO *pImage, const IMAGEINFO *pData);
 void DoDump(char *pszName);
+int  DoVerify(int nBank, const IMAGESEG *pSeg, uchar *pDiffers);
+void DoBench(int nKB);
+void BenchRun(const char *pszTarget, uchar *pData, int base, int nLen);
+void BenchSwap(uchar *pData, int nLen);
+int CompareLatency(const void *a, const void *b);
+int RunJob(int argc, char* argv[]);
+void ResetJobOptions(void);
+void DoDaemon(char *pszSocket);
+int DaemonJob(int argc, char* argv[]);
 void DoSerialInfo(void);
 void DoSerialBig(void);
 void DoBiosUpdate(void);
@@ -242,19 +328,15 @@ void DoReset(void);
 void HandleConsole(void);
 void FilenameSanitize(char *buf);
 int ParseAddress(const char *pBuf);
-int HandleTransfer(uchar *fdata, int base, int flen, int skip, bool part2of6mb);
+int HandleTransfer(const IMAGEINFO *pImage, bool part2of6mb);
+int HandleSixMegTransfer(const IMAGEINFO *pImage);
 void CatVal(char *szOut, int nBufLen, int nVal, int nRow);
-bool DetermineFileInfo(bool bMute, uchar *fdata, int *base, int *flen, int *skip);
+bool DetermineFileInfo(bool bMute, uchar *fdata, int flen, int base, IMAGEINFO *pImage);
 
 /* globals */
 int nextez = 0x1800;
-#ifdef LIBUSB_1
-libusb_device_handle *udev = NULL;
-libusb_context *ctx;
-#else
-usb_dev_handle *udev = NULL;
-#endif
-uchar *fdata = NULL;
+bool g_AsyncUpload = false;				/* set by SendFile, queue blocks instead of sending them */
+uchar *fdata = NULL;					/* input file, mapped or read by jcp_input */
 char g_szFilename[256];
 FILE *fp=NULL;
 bool g_FirstFileSent=false;
@@ -290,18 +372,26 @@ bool g_skipwait=false;				/* used during file transfer to skip waiting for boot
 bool g_OptDoReset = false;
 bool g_OptDoSerialInfo = false;
 bool g_OptDoSerialBig = false;
+bool g_OptBench = false;
+int  g_BenchKB = 1024;				/* benchmark payload size */
+unsigned int *g_pBenchLat = NULL;	/* per-block latencies, in microseconds, while the benchmark runs */
+int  g_nBenchLat = 0;
+int  g_nBenchLatMax = 0;
+bool g_OptDelta = false;			/* erase and program only up to the last flash block which differs */
+bool g_OptCheckBlocks = false;		/* read each block back before the Jag may take it */
+bool g_OptVerify = false;			/* check the flash with the checksum stub before the boot */
+bool g_OptRle = false;				/* compressed RAM uploads, expanded by the decompressor stub */
+bool g_OptDaemon = false;
+char g_szDaemonSocket[256];			/* empty for the default socket */
+bool g_InDaemonJob = false;			/* bye returns to the daemon instead of exiting */
+jmp_buf g_DaemonJmp;
 
 
 /* Main function - entry point */
 int main(int argc, char* argv[])
 {
-	int	base, flen, skip;
 	int	nArg;
-	int	nPos;
-	FILE *fp;
-	int	nUsed;
-	bool fExitLoop;
-	bool bOldConsole;
+	int nRet = 0;
 #ifdef LIBUSB_1
 	const struct libusb_version *libusbver;
 #endif
@@ -327,12 +417,15 @@ int main(int argc, char* argv[])
 	{
 		printf("jcp2 [-?] [-2|6] [-b] [-c] [-d] [-e] [-f] [-h={count}] [-n] [-o] [-q] [-r] [-s]\n");
 		printf("     [-serial=xxxx] [-t={value}] %s [-ubus={1|..}] [-uport={0|..}] [-w]\n", JCP_U_VERSION);
-		printf("     [-x={external console}] [filename] [{$|0x}base]\n");
+		printf("     [-x={external console}] [--bench[={KB}]] [--check] [--daemon[={socket}]]\n");
+		printf("     [--delta] [--remote[={socket}]] [--rle] [--sim[={usec}[,{n}]]] [--verify]\n");
+		printf("     [filename|-] [{$|0x}base]\n");
 		printf("\nValues by default\n");
 		printf("Skunkboard memory bank set as 1\n");
 		printf("$base, or 0xbase, set as $4000\n");
 		printf("Communication timeout set as 1000\n");
 		printf("filename set as NULL\n");
+		printf("filename as '-' reads the standard input, sent to RAM as it arrives\n");
 		printf("\nArguments without parameters - can also be attached together (i.e: -ef, etc.)\n");
 		printf("-? : This display information (optional)\n");
 		printf("-2 : Use Skunkboard memory bank 2 instead of bank 1\n");
@@ -358,6 +451,15 @@ int main(int argc, char* argv[])
 		printf("-ubus={1|..}          : Force USB bus to be used\n");
 		printf("-uport={0|..}         : Force USB port to be used\n");
 		printf("-x={external console} : Shell to external console application\n");
+		printf("--bench[={KB}]        : Benchmark the uploads with a KB payload (default 1024), to RAM, and to flash with '-f'\n");
+		printf("--check               : Read each block back, and send it again if it got corrupted, before the Jag takes it\n");
+		printf("--daemon[={socket}]   : Keep the Skunkboard open and run the jobs of the '--remote' clients\n");
+		printf("--delta               : Read the bank checksums back, flash only up to the last 64k block which differs\n");
+		printf("--remote[={socket}]   : Hand the other arguments over to the daemon\n");
+		printf("--rle                 : Send a RAM upload compressed, the Jag expands it (a stub and the stream above the image)\n");
+		printf("--sim[={usec}]        : Use a simulated Skunkboard, a USB transfer costs usec (default 1000, 0 for no delay)\n");
+		printf("--sim={usec},{n}      : Same, and every n-th queued block is lost, the upload has to resume\n");
+		printf("--verify              : Check the flash against the file, a checksum per 64k block, before the boot ('-f')\n");
 		printf("\nUndocumented arguments\n");
 		printf("-! : Override flash\n");
 		printf("-* : Display the Skunkboard version and his serial number as a banner form\n");
@@ -366,443 +468,871 @@ int main(int argc, char* argv[])
 	}
 	else
 	{
-#ifdef LIBUSB_1
-		if (!libusb_init(&ctx))
+		// thin client, the daemon owns the Skunkboard
+		for (nArg = 1; nArg < argc; nArg++)
+		{
+			if (!strncmp(argv[nArg], "--remote", 8) && ((!argv[nArg][8]) || (argv[nArg][8] == '=')))
+			{
+				return DaemonClient((argv[nArg][8] == '=') ? &argv[nArg][9] : "", argc, argv);
+			}
+		}
+
+		if (EZInit())
 		{
-			libusb_set_debug(ctx, LIBUSB_LOG_LEVEL_NONE);
-#endif
-			// Default basic initialization
-			fdata = (uchar*)malloc(BUFSIZE);	// 6MB + header
-			memset(fdata, 0, BUFSIZE);
-			base = 0x4000;
-			flen = 0;
-			skip = 0;
-			strcpy(g_szFilename, "");
-			strcpy(g_pszExtShell, "");
 			strcpy(USBBusName, "");
+
+			nRet = RunJob(argc, argv);
+
+			PrepDiscard();
+			InputClose();
+			fdata = NULL;
+
+			EZExit();
+		}
+	}
+	
+	return nRet;
+}
+
+
+/* Parse the command line, and do what it asks for */
+/* Also runs the jobs of the daemon, with the command line of the clients */
+int RunJob(int argc, char* argv[])
+{
+	int	base, flen;
+	IMAGEINFO image;
+	int	nArg;
+	int	nPos;
+	bool fExitLoop;
+	bool bOldConsole;
+
+	ResetJobOptions();
+
+	// Default basic initialization
+	PrepDiscard();
+	InputClose();
+	fdata = NULL;
+	base = 0x4000;
+	flen = 0;
+	strcpy(g_szFilename, "");
+	strcpy(g_pszExtShell, "");
 #ifdef JCP_AUTO
-			g_OptAutoMode = true;
+	g_OptAutoMode = true;
 #endif
 
-			// loop on arguments option
-			nArg = 0;
-			while (++nArg < argc)
+	// loop on arguments option
+	nArg = 0;
+	while (++nArg < argc)
+	{
+		// option detection ? (a lone '-' is the standard input)
+		if ((argv[nArg][0] == '-') && (argv[nArg][1]))
+		{
+			nPos = 1;
+			fExitLoop = false;
+
+			// arguments options detection
+			while ((argv[nArg][nPos]) && !fExitLoop)
 			{
-				// option detection ?
-				if (argv[nArg][0] == '-')
+				switch (argv[nArg][nPos++])
 				{
-					nPos = 1;
-					fExitLoop = false;
-
-					// arguments options detection
-					while ((argv[nArg][nPos]) && !fExitLoop)
-					{
-						switch (argv[nArg][nPos++])
-						{
-							// quiet mode (for SkunkGUI)
-						case 'q':
-							g_OptQuietMode = true;
-							break;
+					// quiet mode (for SkunkGUI)
+				case 'q':
+					g_OptQuietMode = true;
+					break;
 
-							// verbose mode
-						case 'v':
-							g_OptVerbose = true;
-							break;
+					// verbose mode
+				case 'v':
+					g_OptVerbose = true;
+					break;
 
-							// flash {filename} to Skunkboard
-						case 'f':
-							g_OptDoFlash = true;
-							base = 0x802000;
-							break;
+					// flash {filename} to Skunkboard
+				case 'f':
+					g_OptDoFlash = true;
+					base = 0x802000;
+					break;
 
-							// Word flash
-						case 'w':
-							g_OptDoSlowFlash = true;
-							break;
+					// Word flash
+				case 'w':
+					g_OptDoSlowFlash = true;
+					break;
 
-							// Erase whole Skunkboard memory flash
-						case 'e':
-							g_OptEraseAllBlocks = true;
-							break;
+					// Erase whole Skunkboard memory flash
+				case 'e':
+					g_OptEraseAllBlocks = true;
+					break;
 
-							// Dump Skunkboard memory flash
-						case 'd':
-							g_OptDoDump = true;
-							break;
+					// Dump Skunkboard memory flash
+				case 'd':
+					g_OptDoDump = true;
+					break;
 
-							// Reset the Jaguar
-						case 'r':
-							g_OptDoReset = true;
-							break;
+					// Reset the Jaguar
+				case 'r':
+					g_OptDoReset = true;
+					break;
 
-							// No boot after the Skunkboard memory flash
-						case 'n':
-							g_OptNoBoot = true;
-							break;
+					// No boot after the Skunkboard memory flash
+				case 'n':
+					g_OptNoBoot = true;
+					break;
 
-							// Boot address
-						case 'b':
-							g_OptOnlyBoot = true;
-							break;
+					// Boot address
+				case 'b':
+					g_OptOnlyBoot = true;
+					break;
 
-							// Override address
-						case 'o':
-							g_OptOverride = true;
-							break;
+					// Override address
+				case 'o':
+					g_OptOverride = true;
+					break;
 
-							// Launch console
-						case 'c':
-							g_OptConsole = true;
-							break;
+					// Launch console
+				case 'c':
+					g_OptConsole = true;
+					break;
 
-							// -s : Display Skunkboard version & serial info
-							// -serial= : Use Skunkboard version
-						case 's':
-							if (!argv[nArg][nPos])
+					// -s : Display Skunkboard version & serial info
+					// -serial= : Use Skunkboard version
+				case 's':
+					if (!argv[nArg][nPos])
+					{
+						g_OptDoSerialInfo = true;
+					}
+					else
+					{
+						if (!strncmp(&argv[nArg][nPos], "erial=", 6))
+						{
+							if (strlen(&argv[nArg][nPos + 6]) == 4)
 							{
-								g_OptDoSerialInfo = true;
+								SkunkboardSerial = (argv[nArg][nPos + 6] - '0') << 12;
+								SkunkboardSerial |= (argv[nArg][nPos + 7] - '0') << 8;
+								SkunkboardSerial |= (argv[nArg][nPos + 8] - '0') << 4;
+								SkunkboardSerial |= (argv[nArg][nPos + 9] - '0');
+								fExitLoop = true;
 							}
 							else
 							{
-								if (!strncmp(&argv[nArg][nPos], "erial=", 6))
-								{
-									if (strlen(&argv[nArg][nPos + 6]) == 4)
-									{
-										SkunkboardSerial = (argv[nArg][nPos + 6] - '0') << 12;
-										SkunkboardSerial |= (argv[nArg][nPos + 7] - '0') << 8;
-										SkunkboardSerial |= (argv[nArg][nPos + 8] - '0') << 4;
-										SkunkboardSerial |= (argv[nArg][nPos + 9] - '0');
-										fExitLoop = true;
-									}
-									else
-									{
-										bye("Error: Serial number must be in 4 digits");
-									}
-								}
-								else
-								{
-									bye("Error: Option is not -s or -serial either");
-								}
+								bye("Error: Serial number must be in 4 digits");
 							}
-							break;
+						}
+						else
+						{
+							bye("Error: Option is not -s or -serial either");
+						}
+					}
+					break;
 
-							// Communication timeout
-						case 't':
-							if ((ComTimeout = atoi((char *)&(argv[nArg][nPos + 1]))) <= 0)
-							{
-								bye("Error: Communication timeout must be above 0");
-							}
-							else
+					// Communication timeout
+				case 't':
+					if ((ComTimeout = atoi((char *)&(argv[nArg][nPos + 1]))) <= 0)
+					{
+						bye("Error: Communication timeout must be above 0");
+					}
+					else
+					{
+						fExitLoop = true;
+					}
+					break;
+
+					// USB port
+				case 'u':
+					if (argv[nArg][nPos])
+					{
+						if (!strncmp(&argv[nArg][nPos], "port=", 5))
+						{
+							USBPort = atoi(&argv[nArg][nPos + 5]);
+							fExitLoop = true;
+						}
+						else
+						{
+							if (!strncmp(&argv[nArg][nPos], "bus=", 4))
 							{
+								sprintf(USBBusName, "bus-%s", &argv[nArg][nPos + 4]);
+								USBBus = atoi(&argv[nArg][nPos + 4]);
 								fExitLoop = true;
 							}
-							break;
-
-							// USB port
-						case 'u':
-							if (argv[nArg][nPos])
+							else
 							{
-								if (!strncmp(&argv[nArg][nPos], "port=", 5))
-								{
-									USBPort = atoi(&argv[nArg][nPos + 5]);
-									fExitLoop = true;
-								}
-								else
-								{
-									if (!strncmp(&argv[nArg][nPos], "bus=", 4))
-									{
-										sprintf(USBBusName, "bus-%s", &argv[nArg][nPos + 4]);
-										USBBus = atoi(&argv[nArg][nPos + 4]);
-										fExitLoop = true;
-									}
-									else
-									{
-										bye("Error: Option is not -uport or -ubus either");
-									}
-								}
+								bye("Error: Option is not -uport or -ubus either");
 							}
-							break;
+						}
+					}
+					break;
 
-							// BIOS update
-						case 'U':
+					// BIOS update
+				case 'U':
 #if defined(INCLUDE_BIOS_10204) || defined(INCLUDE_BIOS_30002)
-							DoBiosUpdate();
-							Sleep(100);
-							DoReset();
-							bye("");
+					DoBiosUpdate();
+					Sleep(100);
+					DoReset();
+					bye("");
 #endif
-							break;
-
-							// Override flash
-							// undocumented! Don't require a flash even if in flash range
-						case '!':
-							g_OptOverrideFlash = true;
-							break;
+					break;
 
-							// undocumented! banner serial! Used in test script. :)
-						case '*':
-							g_OptDoSerialBig = true;
-							break;
+					// Override flash
+					// undocumented! Don't require a flash even if in flash range
+				case '!':
+					g_OptOverrideFlash = true;
+					break;
 
-							// bank 2 selected
-						case '2':
-							nCartBank = 1;
-							printf("Using bank 2\n");
-							break;
+					// undocumented! banner serial! Used in test script. :)
+				case '*':
+					g_OptDoSerialBig = true;
+					break;
 
-							// bank 6 selected
-						case '6':
-							nCartBank = -1;
-							g_SixMegWrite = true;
-							printf("Using 6MB flash mode\n");
-							break;
+					// bank 2 selected
+				case '2':
+					nCartBank = 1;
+					printf("Using bank 2\n");
+					break;
 
-							// get the forced header offset
-						case 'h':
-							if (argv[nArg][nPos] == '=')
-							{
-								g_HeaderSkip = atoi(&argv[nArg][++nPos]);
-								fExitLoop = true;
-							}
-							else
-							{
-								bye("Error: -h option requires the number of bytes to skip");
-							}
-							break;
+					// bank 6 selected
+				case '6':
+					nCartBank = -1;
+					g_SixMegWrite = true;
+					printf("Using 6MB flash mode\n");
+					break;
 
-							// external console shell
-						case 'x':
-							if (argv[nArg][nPos] != '=')
-							{
-								bye("Error: -x option requires external shell filename application to follow");
-							}
-							else
-							{
-								g_OptConsole = true;
-								strcpy(g_pszExtShell, &argv[nArg][++nPos]);
-								fExitLoop = true;
-							}
-							break;
+					// get the forced header offset
+				case 'h':
+					if (argv[nArg][nPos] == '=')
+					{
+						g_HeaderSkip = atoi(&argv[nArg][++nPos]);
+						fExitLoop = true;
+					}
+					else
+					{
+						bye("Error: -h option requires the number of bytes to skip");
+					}
+					break;
 
-							// default
-						default:
-							bye("Error: Unknown option");
-						}
+					// external console shell
+				case 'x':
+					if (argv[nArg][nPos] != '=')
+					{
+						bye("Error: -x option requires external shell filename application to follow");
 					}
-				}
-				else
-				{
-					// $base detection
-					if (argv[nArg][0] == '$')
+					else
 					{
-						if (1 != sscanf(&argv[nArg][1], "%x", &base))
+						g_OptConsole = true;
+						strcpy(g_pszExtShell, &argv[nArg][++nPos]);
+						fExitLoop = true;
+					}
+					break;
+
+					// long options
+				case '-':
+					if (!strncmp(&argv[nArg][nPos], "sim", 3) && ((!argv[nArg][nPos + 3]) || (argv[nArg][nPos + 3] == '=')))
+					{
+						// simulated Skunkboard, optionally with the cost of a transfer
+						g_pEZ = &EZSim;
+						if (argv[nArg][nPos + 3] == '=')
 						{
-							printf("Could not scan address '%s'\n", argv[nArg]);
-							bye("Error: Failed to parse address.");
+							g_SimXferUs = atoi(&argv[nArg][nPos + 4]);
+							if (NULL != strchr(&argv[nArg][nPos + 4], ','))
+							{
+								g_SimDropEvery = atoi(strchr(&argv[nArg][nPos + 4], ',') + 1);
+							}
 						}
 					}
 					else
 					{
-						if ((argv[nArg][0] == '0') && (argv[nArg][1] == 'x'))
+						if (!strncmp(&argv[nArg][nPos], "bench", 5) && ((!argv[nArg][nPos + 5]) || (argv[nArg][nPos + 5] == '=')))
 						{
-							if (1 != sscanf(&argv[nArg][2], "%x", &base))
+							// upload benchmark, optionally with the payload size
+							g_OptBench = true;
+							if ((argv[nArg][nPos + 5] == '=') && ((g_BenchKB = atoi(&argv[nArg][nPos + 6])) <= 0))
 							{
-								printf("Could not scan address '%s'\n", argv[nArg]);
-								bye("Error: Failed to parse address.");
+								bye("Error: Benchmark size must be above 0");
 							}
 						}
 						else
 						{
-							strcpy(g_szFilename, &argv[nArg][0]);
+							if (!strncmp(&argv[nArg][nPos], "daemon", 6) && ((!argv[nArg][nPos + 6]) || (argv[nArg][nPos + 6] == '=')))
+							{
+								// serve the clients, optionally on another socket
+								if (g_InDaemonJob)
+								{
+									bye("Error: Already running in the daemon");
+								}
+								g_OptDaemon = true;
+								strcpy(g_szDaemonSocket, (argv[nArg][nPos + 6] == '=') ? &argv[nArg][nPos + 7] : "");
+							}
+							else
+							{
+								if (!strcmp(&argv[nArg][nPos], "delta"))
+								{
+									// delta flashing
+									g_OptDelta = true;
+								}
+								else
+								{
+									if (!strcmp(&argv[nArg][nPos], "check"))
+									{
+										// checked blocks
+										g_OptCheckBlocks = true;
+									}
+									else
+									{
+										if (!strcmp(&argv[nArg][nPos], "verify"))
+										{
+											// flash verification
+											g_OptVerify = true;
+										}
+										else
+										{
+											if (!strcmp(&argv[nArg][nPos], "rle"))
+											{
+												// compressed RAM uploads
+												g_OptRle = true;
+											}
+											else
+											{
+												// the client side has already been taken care of by main
+												if (strncmp(&argv[nArg][nPos], "remote", 6))
+												{
+													bye("Error: Unknown option");
+												}
+											}
+										}
+									}
+								}
+							}
 						}
 					}
+					fExitLoop = true;
+					break;
+
+					// default
+				default:
+					bye("Error: Unknown option");
 				}
 			}
-
-			// Display the Bios & Serial in a simple text
-			if (g_OptDoSerialInfo)
+		}
+		else
+		{
+			// $base detection
+			if (argv[nArg][0] == '$')
 			{
-				DoSerialInfo();
+				if (1 != sscanf(&argv[nArg][1], "%x", &base))
+				{
+					printf("Could not scan address '%s'\n", argv[nArg]);
+					bye("Error: Failed to parse address.");
+				}
 			}
 			else
 			{
-				// Display the Bios & Serial in a banner form
-				if (g_OptDoSerialBig)
+				if ((argv[nArg][0] == '0') && (argv[nArg][1] == 'x'))
 				{
-					DoSerialBig();
+					if (1 != sscanf(&argv[nArg][2], "%x", &base))
+					{
+						printf("Could not scan address '%s'\n", argv[nArg]);
+						bye("Error: Failed to parse address.");
+					}
 				}
 				else
 				{
-					// Do Jaguar Reset
-					if (g_OptDoReset)
+					strcpy(g_szFilename, &argv[nArg][0]);
+				}
+			}
+		}
+	}
+
+	// Display the Bios & Serial in a simple text
+	if (g_OptDoSerialInfo)
+	{
+		DoSerialInfo();
+	}
+	else
+	{
+		// Display the Bios & Serial in a banner form
+		if (g_OptDoSerialBig)
+		{
+			DoSerialBig();
+		}
+		else
+		{
+			// Do Jaguar Reset
+			if (g_OptDoReset)
+			{
+				DoReset();
+			}
+			else
+			{
+				// Serve the thin clients, never returns
+				if (g_OptDaemon)
+				{
+					DoDaemon(g_szDaemonSocket);
+				}
+
+				// Upload benchmark
+				if (g_OptBench)
+				{
+					DoBench(g_BenchKB);
+					bye("Process: Benchmark complete.");
+				}
+
+				// Boot only not selected
+				if (!g_OptOnlyBoot)
+				{
+					if (!strlen(g_szFilename) && (!g_OptConsole))
 					{
-						DoReset();
+						bye("Error: No filename was specified");
 					}
 					else
 					{
-						// Boot only not selected
-						if (!g_OptOnlyBoot)
+						if (!strlen(g_szFilename))
 						{
-							if (!strlen(g_szFilename) && (!g_OptConsole))
+							// user seems to want to try to attach the console, so don't try to load stuff
+							if (!g_OptOnlyBoot)
 							{
-								bye("Error: No filename was specified");
+								g_OptOnlyConsole = true;
 							}
-							else
+						}
+						else
+						{
+							if (!g_OptDoDump)
 							{
-								if (!strlen(g_szFilename))
+								// a pipe is read up to the headers only, the rest comes as it is uploaded
+								if (NULL == (fdata = InputOpen(g_szFilename, BUFSIZE, STREAMHEAD, &flen)))
 								{
-									// user seems to want to try to attach the console, so don't try to load stuff
-									if (!g_OptOnlyBoot)
-									{
-										g_OptOnlyConsole = true;
-									}
+									bye("Error: Couldn't read file");
 								}
-								else
-								{
-									if (!g_OptDoDump)
-									{
-										fp = fopen(g_szFilename, "rb");
 
-										if (NULL == fp || (flen = (int)fread(fdata, 1, BUFSIZE, fp)) < 1)
-										{
-											bye("Error: Couldn't read file");
-										}
-
-										fclose(fp);
+								// the flash is erased for the image length, it has to be known first
+								if ((!InputComplete()) && ((g_OptDoFlash) || (nCartBank == -1) || (g_OptOnlyBoot)))
+								{
+									flen = InputMore(BUFSIZE);
+								}
 
-										fp = NULL;
-									}
-									else
-									{
-										flen = 0;
-									}
+								if (g_OptVerbose)
+								{
+									printf("Input file %s, %d bytes%s\n", InputKind(), flen, InputComplete() ? "" : " so far");
 								}
 							}
+							else
+							{
+								flen = 0;
+							}
 						}
+					}
+				}
 
-						// Skunkboard memory flash dump
-						if (g_OptDoDump)
-						{
-							DoDump(g_szFilename);
-							bye("Process: Dump complete.");
-						}
+				// Skunkboard memory flash dump
+				if (g_OptDoDump)
+				{
+					DoDump(g_szFilename);
+					bye("Process: Dump complete.");
+				}
+
+				// Bit of a hack, preparse the file to figure out its true length and address
+				// this is done once, the image is then handed down as it is
+				DetermineFileInfo(false, fdata, flen, base, &image);
+
+				// the upload of a pipe starts with its first bytes, when it goes to the RAM
+				if ((!InputComplete()) && (!StreamImage(&image)))
+				{
+					flen = InputMore(BUFSIZE);
+					DetermineFileInfo(true, fdata, flen, base, &image);
+				}
+
+				flen = image.flen;
+
+				// 6MB is not really necessary since the filename is smaller than 4MB
+				if ((nCartBank == -1) && (flen <= (4 * 1024 * 1024 - 0x2000)) && (!g_OptOnlyBoot))
+				{
+					printf("6MB mode not required, will flash bank 1 instead\n");
+					nCartBank = 0;
+				}
 
-						// Bit of a hack, preparse the file to figure out its true length and address
-						DetermineFileInfo(false, fdata, &base, &flen, &skip);
+				// 6MB can be selectioned due to the filename size even if 6MB argument is not set
+				if ((g_OptAutoMode) && (nCartBank != -1) && (flen > (4 * (1024 * 1024))))
+				{
+					printf("Assuming 6MB mode...\n");
+					nCartBank = -1;
+				}
 
-						// 6MB is not really necessary since the filename is smaller than 4MB
-						if ((nCartBank == -1) && (flen <= (4 * 1024 * 1024 - 0x2000)) && (!g_OptOnlyBoot))
+				// Flash
+				if (g_OptDoFlash)
+				{
+					if (flen == 0)
+					{
+						bye("Error: File must be specified with flash!");
+					}
+					else
+					{
+						if (g_OptNoBoot)
 						{
-							printf("6MB mode not required, will flash bank 1 instead\n");
-							nCartBank = 0;
+							printf("Warning: -n (no boot) option not supported during flashing\n");
+							g_OptNoBoot = false;
 						}
 
-						// 6MB can be selectioned due to the filename size even if 6MB argument is not set
-						if ((g_OptAutoMode) && (nCartBank != -1) && (flen > (4 * (1024 * 1024))))
+						// this is an estimate, headers may make it possible, or the 2k bios
+						// gap may make it impossible!
+						if ((flen > (4 * (1024 * 1024))) && (-1 != nCartBank))
 						{
-							printf("Assuming 6MB mode...\n");
-							nCartBank = -1;
+							bye("Warning: File is too large to be flashed to a 4MB bank, try 6MB mode\n");
 						}
 
-						// Flash
-						if (g_OptDoFlash)
+						// the stub checks a range of the bank, the flash between segments is not known
+						if ((g_OptVerify) && ((1 != image.nSegs) || (image.bStream)))
 						{
-							if (flen == 0)
-							{
-								bye("Error: File must be specified with flash!");
-							}
-							else
-							{
-								if (g_OptNoBoot)
-								{
-									printf("Warning: -n (no boot) option not supported during flashing\n");
-									g_OptNoBoot = false;
-								}
-
-								// this is an estimate, headers may make it possible, or the 2k bios
-								// gap may make it impossible!
-								if ((flen > (4 * (1024 * 1024))) && (-1 != nCartBank))
-								{
-									bye("Warning: File is too large to be flashed to a 4MB bank, try 6MB mode\n");
-								}
-							}
+							printf("Warning: --verify needs a single segment image, not verifying\n");
+							g_OptVerify = false;
 						}
+					}
+				}
 
-						// we handle 6MB mode as two separate uploads, since we can't run it directly
-						if (nCartBank == -1)
-						{
-							if (!g_OptOnlyBoot)
-							{
-								bOldConsole = g_OptConsole;
-								// tweak things up a bit to make this work
-								printf("6MB mode will require two transfers...\n");
-								nCartBank = 0;
-								g_OptNoBoot = true;
-								g_OptConsole = false;
-								nUsed = HandleTransfer(fdata, base, flen, skip, false);
-								WaitForBothBuffers();
-
-								printf("Flashing second bank...\n");
-								nCartBank = 1;
-								g_OptConsole = bOldConsole;
-								g_OptFlashActive = false;	// this is necessary because we have to load the flasher stub again
-								HandleTransfer(fdata + nUsed, 0x800000, flen - nUsed, 0, true);
-								WaitForBothBuffers();
-							}
+				// we handle 6MB mode as two separate uploads, since we can't run it directly
+				if (nCartBank == -1)
+				{
+					if (!g_OptOnlyBoot)
+					{
+						HandleSixMegTransfer(&image);
+					}
 
-							printf("Requesting start...\n");
-							g_OptNoBoot = false;
-							g_OptOnlyBoot = true;
-							nCartBank = -1;
-							DoFile(fdata, base, 0, 0, true);
-						}
-						else
+					printf("Requesting start...\n");
+					g_OptNoBoot = false;
+					g_OptOnlyBoot = true;
+					nCartBank = -1;
+					DoFile(fdata, image.entry, 0, 0);
+				}
+				else
+				{
+					if ((g_OptVerify) && (g_OptDoFlash) && (!g_OptOnlyBoot))
+					{
+						// back to the BIOS once flashed, the flash is checked, then booted
+						bOldConsole = g_OptConsole;
+						g_OptConsole = false;
+						g_OptNoBoot = true;
+						HandleTransfer(&image, false);
+						WaitForBothBuffers(0);
+
+						if (DoVerify(nCartBank, &image.segs[0], NULL))
 						{
-							HandleTransfer(fdata, base, flen, skip, false);
+							bye("Error: The flash does not match the file, not booting it");
 						}
+
+						printf("Requesting start...\n");
+						g_OptNoBoot = false;
+						g_OptOnlyBoot = true;
+						g_OptConsole = bOldConsole;
+						DoFile(fdata, image.entry, 0, 0);
+					}
+					else
+					{
+						HandleTransfer(&image, false);
 					}
 				}
 			}
+		}
+	}
 
-			free(fdata);
-			fdata = NULL;
+	return 0;
+}
+
+
+/* Back to the options by default, for the next daemon job */
+/* Note: the connection options (USB bus/port, serial, timeout, simulation) are kept */
+void ResetJobOptions(void)
+{
+	nextez = 0x1800;
+	g_FirstFileSent = false;
+	g_OptDoFlash = false;
+	g_OptDoSlowFlash = false;
+	g_OptOverrideFlash = false;
+	g_OptEraseAllBlocks = false;
+	g_OptDoDump = false;
+	g_OptFlashActive = false;
+	g_OptNoBoot = false;
+	g_OptOnlyBoot = false;
+	g_OptOverride = false;
+	g_OptConsole = false;
+	g_OptOnlyConsole = false;
+	g_OptConsoleUp = false;
+	g_OptSilentConsole = false;
+	g_OptVerbose = false;
+	g_OptAutoMode = false;
+	nCartBank = 0;
+	g_SixMegWrite = false;
+	g_HeaderSkip = 0;
+	g_OptQuietMode = false;
+	g_skipwait = false;
+	g_OptDoReset = false;
+	g_OptDoSerialInfo = false;
+	g_OptDoSerialBig = false;
+	g_OptBench = false;
+	g_BenchKB = 1024;
+	g_OptDelta = false;
+	g_OptCheckBlocks = false;
+	g_OptVerify = false;
+	g_OptRle = false;
+	g_OptDaemon = false;
+}
+
+
+/* Keep the Skunkboard open, and run the jobs sent by the thin clients (--remote) */
+void DoDaemon(char *pszSocket)
+{
+	// open it and install turbow once for all
+	if (!EZIsOpen())
+	{
+		findEZ(true, true);
+	}
 
-			if (NULL != udev)
+	DaemonServe(pszSocket, DaemonJob);
+	bye("Error: Daemon failed to serve the clients");
+}
+
+
+/* Run a client command line, a bye ends the job only */
+int DaemonJob(int argc, char* argv[])
+{
+	int nRet;
+
+	if (setjmp(g_DaemonJmp))
+	{
+		nRet = 1;
+	}
+	else
+	{
+		g_InDaemonJob = true;
+		nRet = RunJob(argc, argv);
+	}
+
+	g_InDaemonJob = false;
+	PrepDiscard();
+	InputClose();
+	fdata = NULL;
+
+	// a reset closes the handle, reopen it now rather than at the next job
+	if (!EZIsOpen())
+	{
+		findEZ(true, false);
+	}
+
+	return nRet;
+}
+
+
+/* handles a delta flash - the bank checksums are read back first, then it is erased */
+/* up to the last block which differs, and the image programmed up to there */
+int HandleDeltaTransfer(const IMAGEINFO *pImage)
+{
+	IMAGEINFO part;
+	const IMAGESEG *pSeg = &pImage->segs[0];
+	uchar differs[DELTA_MAXBLOCKS];
+	int nBank = (nCartBank == 1) ? 1 : 0;
+	int nErase;
+	bool bNoBoot = g_OptNoBoot;		// set to check the flash before the boot (--verify)
+
+	// a cart image is a single segment
+	if (1 != pImage->nSegs)
+	{
+		bye("Error: Delta flashing needs a single segment image");
+	}
+
+	// what the bank holds now, the Jag is back in the BIOS afterwards (reset first in auto mode)
+	ResetIfNotInBios();
+	DoVerify(nBank, pSeg, differs);
+
+	part = *pImage;
+	g_OptNoBoot = false;			// the flash stub has to start
+
+	if (-1 == (nErase = DeltaPlan(differs, pSeg->base, pSeg->nLen)))
+	{
+		printf("Delta: the image does not fit a delta flash, flashing it all\n");
+		PrepStart(&part);
+		DoFlash(pImage);
+	}
+	else
+	{
+		if (!nErase)
+		{
+			// same image, just boot it, unless it is verified first
+			printf("Delta: bank %d is up to date\n", nBank + 1);
+			if (!bNoBoot)
 			{
-#ifdef LIBUSB_1
-				libusb_close(udev);
-#else
-				usb_close(udev);
-#endif
+				g_OptOnlyBoot = true;
+				DoImage(pImage);
+				g_OptOnlyBoot = false;
 			}
-#ifdef LIBUSB_1
-			libusb_exit(ctx);
+			g_OptNoBoot = bNoBoot;
+			return pImage->flen;
 		}
-#endif
+
+		// the blocks after the last erased one already hold the image, so the start request goes with the last one sent
+		if (part.segs[0].nLen > FLASH_BASE + nErase * FLASH_BLOCKSIZE - pSeg->base)
+		{
+			part.segs[0].nLen = FLASH_BASE + nErase * FLASH_BLOCKSIZE - pSeg->base;
+		}
+		part.flen = part.skip + part.segs[0].nLen;
+
+		printf("Delta: erasing %d blocks of bank %d, sending %d of %d bytes\n", nErase, nBank + 1, part.segs[0].nLen, pSeg->nLen);
+		PrepStart(&part);
+		DoFlashBlocks(nErase);
 	}
-	
-	return 0;
+
+	g_OptNoBoot = bNoBoot;
+	g_OptFlashActive = true;
+	DoImage(&part);
+
+	return pImage->flen;
+}
+
+
+/* handles a compressed upload - the decompressor stub and the stream are sent above */
+/* the image, and started, the stub expands the image and starts it */
+/* falls back to a plain upload if it does not fit, or is not any smaller */
+int HandleRleTransfer(const IMAGEINFO *pImage)
+{
+	IMAGEINFO blob;
+	uchar *pBlob;
+	int nBlob, nBase;
+
+	if (0 == (nBlob = RleBuild(&pImage->segs[0], pImage->entry, &pBlob, &nBase)))
+	{
+		printf("RLE: not worth it, or no room above the image, sending it as it is\n");
+		return DoImage(pImage);
+	}
+
+	printf("RLE: sending %d bytes for %d, expanded to $%06X\n", nBlob, pImage->segs[0].nLen + pImage->segs[0].nZero, pImage->segs[0].base);
+	ImageFromRange(&blob, pBlob, nBase, nBlob, 0);
+	DoImage(&blob);
+	free(pBlob);
+
+	return pImage->flen;
+}
+
+
+/* handles an upload without its zeros - the segments are sent without a boot, then */
+/* the clearing stub and its ranges above the image, started, clear them and start it */
+/* falls back to sending the zeros if there is no room for the stub */
+int HandleBssTransfer(const IMAGEINFO *pImage, const IMAGEINFO *pData)
+{
+	IMAGEINFO blob;
+	uchar *pBlob;
+	int nBlob, nBase;
+	bool bOldConsole;
+
+	if (0 == (nBlob = BssBuild(pImage, &pBlob, &nBase)))
+	{
+		if (g_OptVerbose)
+		{
+			printf("BSS: no room above the image, the zeros are sent\n");
+		}
+		return DoImage(pImage);
+	}
+
+	bOldConsole = g_OptConsole;
+	g_OptConsole = false;
+	g_OptNoBoot = true;
+	DoImage(pData);
+
+	g_OptNoBoot = false;
+	g_OptConsole = bOldConsole;
+	ImageFromRange(&blob, pBlob, nBase, nBlob, 0);
+	DoImage(&blob);
+	free(pBlob);
+
+	return pImage->flen;
 }
 
 
 /* handles the transfer and the flash portion */
 /* returns the number of bytes actually processed (not necessarily sent, includes headers) */
-int HandleTransfer(uchar *fdata, int base, int flen, int skip, bool part2of6mb)
+int HandleTransfer(const IMAGEINFO *pImage, bool part2of6mb)
 {
+	IMAGEINFO image;
 	bool bOldNoBoot;
 
+	// only up to the last block which differs from the bank content
+	if ((g_OptDoFlash) && (g_OptDelta) && (!part2of6mb) && (nCartBank != -1) && (!g_OptEraseAllBlocks))
+	{
+		return HandleDeltaTransfer(pImage);
+	}
+
+	// compressed, when it is a RAM upload that starts
+	if ((g_OptRle) && (!g_OptDoFlash) && (!g_OptNoBoot) && (!g_OptOnlyBoot) && (!pImage->bStream) && (1 == pImage->nSegs))
+	{
+		return HandleRleTransfer(pImage);
+	}
+
+	// the zeros are cleared on the Jag, when it is a RAM upload that starts
+	if ((!g_OptDoFlash) && (!g_OptNoBoot) && (!g_OptOnlyBoot) && (!pImage->bStream) && (BssSplit(pImage, &image)))
+	{
+		return HandleBssTransfer(pImage, &image);
+	}
+
+	// the upload is prepared while the Jag gets ready for it
+	if (!pImage->bStream)
+	{
+		image = *pImage;
+		if (g_SixMegWrite)
+		{
+			SixMegTrim(&image);
+		}
+		PrepStart(&image);
+	}
+
 	if (g_OptDoFlash)
 	{
 		bOldNoBoot=g_OptNoBoot;		// loading the flash program ALWAYS requires NoBoot to be false
 		g_OptNoBoot=false;
 		
-		DoFlash(flen);
+		DoFlash(pImage);
 
 		g_OptNoBoot=bOldNoBoot;
 		g_OptFlashActive=true;
 	}
 
-	return DoFile(fdata, base, flen, skip, part2of6mb);
+	return DoImage(pImage);
+}
+
+
+/* 6MB mode: the flash stub takes one bank at a time, so the image goes as */
+/* two halves, each with its own stub load and erase. The first half returns */
+/* to the BIOS (-2), the second one too, then the cart is started in 6MB mode */
+int HandleSixMegTransfer(const IMAGEINFO *pImage)
+{
+	IMAGEINFO part1, part2;
+	bool bOldConsole = g_OptConsole;
+	int nBlocks1, nBlocks2;
+
+	part1 = *pImage;
+	SixMegTrim(&part1);
+	ImageFromRange(&part2, part1.segs[0].pData + part1.segs[0].nLen, 0x800000, pImage->segs[0].nLen - part1.segs[0].nLen, 0);
+
+	// the halves are trimmed and placed as 6MB images, even when it was only guessed (auto mode)
+	g_SixMegWrite = true;
+
+	nBlocks1 = ErasePlan(&part1, 0, true);
+	nBlocks2 = ErasePlan(&part2, 1, true);
+	printf("6MB mode, two flash passes: %d blocks to erase in bank 1, then %d in bank 2 (about %ds)\n", nBlocks1, nBlocks2, ((nBlocks1 + nBlocks2 + 2) * 300) / 1000);
+
+	// tweak things up a bit to make this work
+	nCartBank = 0;
+	g_OptNoBoot = true;
+	g_OptConsole = false;
+	HandleTransfer(&part1, false);
+	WaitForBothBuffers(0);
+
+	printf("Flashing second bank...\n");
+	nCartBank = 1;
+	g_OptFlashActive = false;	// this is necessary because we have to load the flasher stub again
+	HandleTransfer(&part2, true);
+	WaitForBothBuffers(0);
+
+	if (g_OptVerify)
+	{
+		if (DoVerify(0, &part1.segs[0], NULL) + DoVerify(1, &part2.segs[0], NULL))
+		{
+			bye("Error: The flash does not match the file, not booting it");
+		}
+	}
+
+	g_OptConsole = bOldConsole;
+	return pImage->flen;
 }
 
 
@@ -813,35 +1343,82 @@ void Spin(void)
     {
 		if (++nSpinner > (sizeof(szSpin)-1))
 		{
-			nSpinner = 0;
+			nSpinner = 0;
+		}
+
+		putchar(szSpin[nSpinner]);
+		putchar('\b');
+		fflush(stdout);
+	}
+}
+
+
+/* wait for the Jaguar to come back from a reset: the EZ-HOST on the bus */
+/* again, and both buffers cleared by the BIOS. Returns the ms since tReset */
+int WaitForReady(unsigned long long tReset)
+{
+	POLLER poll;
+	unsigned short nWord1, nWord2;
+
+	PollStart(&poll, 0, true);
+
+	for (;;)
+	{
+		if (GetMicroCount() - tReset > (unsigned long long)RESET_TIMEOUTMS * 1000)
+		{
+			bye("Error: can't connect with skunkboard, it did not come back from the reset");
 		}
 
-		putchar(szSpin[nSpinner]);
-		putchar('\b');
-		fflush(stdout);
+		if (!EZIsOpen())
+		{
+			if (!EZReopen())
+			{
+				// still enumerating, hotplug tells when it's back, or we look again
+				EZWaitArrival(1000);
+			}
+		}
+		else
+		{
+			if ((EZRead(0x1800 + 0xFEA, &nWord1, 2) != 2) || (EZRead(0x2800 + 0xFEA, &nWord2, 2) != 2))
+			{
+				// the handle went away with the reset, it is opened again after the wait
+				EZClose();
+			}
+			else if (PollIsFree(nWord1) && PollIsFree(nWord2))
+			{
+				break;
+			}
+		}
+
+		PollIdle(&poll);
 	}
+
+	return (int)((GetMicroCount() - tReset) / 1000);
 }
 
 
 /* reset the Jaguar then reconnect to it - pass true not to wait on the buffers */
 void DoResetAndReconnect(bool bForce)
 {
+	unsigned long long tReset;
+	int nMs;
+
 	if (!bForce) 
 	{
-		WaitForBothBuffers();	// make sure the Jag is done the last command
+		WaitForBothBuffers(0);	// make sure the Jag is done the last command
 	}
 
 	DoReset();
-	Sleep(2000);			// takes the Jag about 2s to come up
+	tReset = GetMicroCount();
+
+	// no fixed delay, we're up as soon as the Jag clears the buffers
+	nMs = WaitForReady(tReset);
 
-	while (NULL == udev)
+	if ( (g_OptVerbose) || (!g_OptSilentConsole) )
 	{
-		Sleep(100);
-		udev = findEZ(true, false);
+		printf("Jaguar ready %d ms after the reset.\n", nMs);
 	}
 
-	WaitForBothBuffers();	// when the Jag clears the buffers, we're up
-
 	// reset pointer
 	nextez = 0x1800;
 }
@@ -858,7 +1435,7 @@ void DoResetAndBoot(void)
 	g_OptOnlyBoot = true;
 	g_OptFlashActive = false;
 
-	DoFile((uchar*)&tmp, 0x802000, 0, 0, true);
+	DoFile((uchar*)&tmp, 0x802000, 0, 0);
 }
 
 
@@ -869,11 +1446,7 @@ void LockBothBuffers(void)
 
 	for (;;)
 	{
-#ifndef LIBUSB_1
-		if (usb_control_msg(udev, 0x40, 0xfe, 4080, 0x1800+0xFEA, (char*)&tmp, 2, ComTimeout) == 2)
-#else
-		if (libusb_control_transfer(udev, 0x40, 0xfe, 4080, 0x1800 + 0xFEA, (char*)&tmp, 2, ComTimeout) == 2)
-#endif
+		if (EZWrite(0x1800 + 0xFEA, &tmp, 2) == 2)
 		{
 			break;
 		}
@@ -883,11 +1456,7 @@ void LockBothBuffers(void)
 
 	for (;;)
 	{
-#ifndef LIBUSB_1
-		if (usb_control_msg(udev, 0x40, 0xfe, 4080, 0x2800+0xFEA, (char*)&tmp, 2, ComTimeout) == 2)
-#else
-		if (libusb_control_transfer(udev, 0x40, 0xfe, 4080, 0x2800 + 0xFEA, (char*)&tmp, 2, ComTimeout) == 2)
-#endif
+		if (EZWrite(0x2800 + 0xFEA, &tmp, 2) == 2)
 		{
 			break;
 		}
@@ -904,19 +1473,11 @@ bool TestIfBuffersLocked(void)
 	volatile short poll = 0;
 	bool bRet = false;
 
-#ifndef LIBUSB_1
-	if (usb_control_msg(udev, 0xC0, 0xff, 4, 0x1800+0xFEA, (char*)&poll, 2, ComTimeout) == 2)
-#else
-	if (libusb_control_transfer(udev, 0xC0, 0xff, 4, 0x1800 + 0xFEA, (char*)&poll, 2, ComTimeout) == 2)
-#endif
+	if (EZRead(0x1800 + 0xFEA, &poll, 2) == 2)
 	{
 		if (poll == 0)
 		{
-#ifndef LIBUSB_1
-			if (usb_control_msg(udev, 0xC0, 0xff, 4, 0x2800+0xFEA, (char*)&poll, 2, ComTimeout) == 2)
-#else
-			if (libusb_control_transfer(udev, 0xC0, 0xff, 4, 0x2800 + 0xFEA, (char*)&poll, 2, ComTimeout) == 2)
-#endif
+			if (EZRead(0x2800 + 0xFEA, &poll, 2) == 2)
 			{
 				if (poll == 0)
 				{
@@ -940,52 +1501,36 @@ bool TestIfBuffersLocked(void)
 }
 
 
-/* wait for the Jag to mark both buffers as free */
-void WaitForBothBuffers(void)
+/* in auto mode, reset a Jag which still runs a program (both buffers locked), before the first file */
+void ResetIfNotInBios(void)
 {
-	volatile short poll = 0;
-
-	// first buffer
-	do
+	if (!EZIsOpen())
 	{
-		Spin();
+		findEZ(true, true);
+	}
 
-#ifndef LIBUSB_1
-		if (usb_control_msg(udev, 0xC0, 0xff, 4, 0x1800+0xFEA, (char*)&poll, 2, ComTimeout) != 2)
-#else
-		if (libusb_control_transfer(udev, 0xC0, 0xff, 4, 0x1800 + 0xFEA, (char*)&poll, 2, ComTimeout) != 2)
-#endif
-		{
-			Reattach();
-		}
-		else
+	if ((g_OptAutoMode) && (!g_FirstFileSent) && (TestIfBuffersLocked()))
+	{
+		if (g_OptVerbose)
 		{
-			Sleep(100);
+			printf("The Jaguar is not in the BIOS, resetting it\n");
 		}
+		DoResetAndReconnect(true);
 	}
-	while (-1 != poll);
+}
+
+
+/* wait for the Jag to mark both buffers as free */
+/* nHintMs is how long it should take, if known, 0 otherwise */
+void WaitForBothBuffers(int nHintMs)
+{
+	// first buffer
+	PollWord(0x1800 + 0xFEA, PollIsFree, nHintMs, 0, true, NULL);
 
 	printf(".");
 	
-	// second buffer
-	do
-	{
-		Spin();
-
-#ifdef LIBUSB_1
-		if (libusb_control_transfer(udev, 0xC0, 0xff, 4, 0x2800 + 0xFEA, (char*)&poll, 2, ComTimeout) != 2)
-#else
-		if (usb_control_msg(udev, 0xC0, 0xff, 4, 0x2800+0xFEA, (char*)&poll, 2, ComTimeout) != 2)
-#endif
-		{
-			Reattach();
-		}
-		else
-		{
-			Sleep(100);
-		}
-	}
-	while (-1 != poll);
+	// second buffer, right behind
+	PollWord(0x2800 + 0xFEA, PollIsFree, 0, 0, true, NULL);
 
 	printf(".\n");
 }
@@ -1003,19 +1548,15 @@ void DoReset(void)
 	}
 
 	// Reset is 0xc028=2, 0xc028=0
-	if (NULL == udev)
+	if (!EZIsOpen())
 	{
-		udev = findEZ(true, true);		// we used to not load turbow here, but for better reconnect, we want to lock buffers first!
+		findEZ(true, true);		// we used to not load turbow here, but for better reconnect, we want to lock buffers first!
 	}
 
 	LockBothBuffers();		// carries through the reset
 
 	// Send command
-#ifdef LIBUSB_1
-	if (libusb_control_transfer(udev, 0x40, 0xff, 10, 0x304C, (char*)cmd, 10, ComTimeout) != 10)
-#else
-	if (usb_control_msg(udev, 0x40, 0xff, 10, 0x304C, (char*)cmd, 10, ComTimeout) != 10)
-#endif
+	if (EZScan(10, cmd, 10) != 10)
 	{
 		bye("Error: Reset assert failed to send.");
 	}
@@ -1027,58 +1568,45 @@ void DoReset(void)
 		cmd[7] = 0;
 
 		// Send command
-#ifdef LIBUSB_1
-		if (libusb_control_transfer(udev, 0x40, 0xff, 10, 0x304C, (char*)cmd, 10, ComTimeout) != 10)
-#else
-		if (usb_control_msg(udev, 0x40, 0xff, 10, 0x304C, (char*)cmd, 10, ComTimeout) != 10)
-#endif
+		if (EZScan(10, cmd, 10) != 10)
 		{
 			bye("Error: Reset release failed to send.");
 		}
 		else
 		{
 			/* in case it's used elsewhere */
-			if (NULL != udev)
-			{
-#ifdef LIBUSB_1
-				libusb_close(udev);
-#else
-				usb_close(udev);
-#endif
-			}
-
-			udev = NULL;
+			EZClose();
 		}
 	}
 }
 
 
 /* Prepare the Jaguar to receive a flash file */
-void DoFlash(int nLen)
+void DoFlash(const IMAGEINFO *pImage)
 {
-	volatile short poll=0;
-	int idx;
 	unsigned int nBlocks;
 
-	g_OptSilentConsole = true; 
-
-	// due to the flash layout, we can't do a straight sector erase
-	// we compromise some and erase only half if we don't need it
-	// all - that seems to work okay.
-	if (nLen <= (2*(1024*1024)))
+	// due to the flash layout, we can't do a straight sector erase, the
+	// stub erases from the start of the bank: up to the last block written
+	if ((g_OptEraseAllBlocks) || (pImage->bStream))
 	{
-		nBlocks = 32;
+		nBlocks = 62;
 	}
 	else
 	{
-		nBlocks = 62;
+		nBlocks = ErasePlan(pImage, (nCartBank == 1) ? 1 : 0, g_SixMegWrite);
 	}
 
-	// just in case it's needed
-	if (g_OptEraseAllBlocks)
-	{
-		nBlocks=62;
-	}
+	DoFlashBlocks(nBlocks);
+}
+
+
+/* Load the flash stub, and wait for it to erase nBlocks 64k blocks from the bank start */
+void DoFlashBlocks(unsigned int nBlocks)
+{
+	int idx;
+
+	g_OptSilentConsole = true; 
 
 	// restrict to the legal range
 	if (nBlocks > 62)
@@ -1138,59 +1666,29 @@ void DoFlash(int nLen)
 		}
 	}
 
-	DoFile((uchar*)FLASHSTUB, 0x4100, SIZE_OF_FLASHSTUB, 168, true);
+	// the BIOS loads the stub, in auto mode a Jag still running the last cart is reset first
+	ResetIfNotInBios();
+
+	DoFile((uchar*)FLASHSTUB, 0x4100, SIZE_OF_FLASHSTUB, 168);
 
 	// Don't scan for the buffers to be ready till they are zeroed, indicates start of flash
 	// first buffer
-	do
-	{
-		Spin();
-
-#ifdef LIBUSB_1
-		if (libusb_control_transfer(udev, 0xC0, 0xff, 4, 0x1800 + 0xFEA, (char*)&poll, 2, ComTimeout) != 2)
-#else
-		if (usb_control_msg(udev, 0xC0, 0xff, 4, 0x1800+0xFEA, (char*)&poll, 2, ComTimeout) != 2)
-#endif
-		{
-			Reattach();
-		}
-		else
-		{
-			Sleep(100);
-		}
-	}
-	while (0 != poll);
+	PollWord(0x1800 + 0xFEA, PollIsZero, 0, 0, true, NULL);
 	
 	printf(".");
 	
 	// second buffer
-	do
-	{
-		Spin();
-
-#ifdef LIBUSB_1
-		if (libusb_control_transfer(udev, 0xC0, 0xff, 4, 0x2800 + 0xFEA, (char*)&poll, 2, ComTimeout) != 2)
-#else
-		if (usb_control_msg(udev, 0xC0, 0xff, 4, 0x2800+0xFEA, (char*)&poll, 2, ComTimeout) != 2)
-#endif
-		{
-			Reattach();
-		} 
-		else 
-		{
-			Sleep(100);
-		}
-	}
-	while (0 != poll);
+	PollWord(0x2800 + 0xFEA, PollIsZero, 0, 0, true, NULL);
 	
 	printf(".\n");
 
 	// blocks are 64k each, and each takes about 300ms (somewhat less) to erase
+	nBlocks &= 0xffff;
 	printf("Waiting for erase to complete (about %ds)", ((nBlocks+1)*300)/1000);
 
 	// Both buffers will be marked ready when the
-	// Jag is ready to proceed.
-	WaitForBothBuffers();
+	// Jag is ready to proceed, sleep through most of the erase
+	WaitForBothBuffers((nBlocks+1)*300);
 
 	g_OptSilentConsole = false;
 
@@ -1245,9 +1743,13 @@ void DoDump(char *pszName)
 		{
 			ROMDUMP[0xab] = 1;
 		}
+		else
+		{
+			ROMDUMP[0xab] = 0;		// the daemon may have dumped bank 2 before
+		}
 
 		printf("Beginning dump to '%s'...\n", pszName);
-		DoFile((uchar*)ROMDUMP, 0x10000, SIZE_OF_ROMDUMP, 168, true);
+		DoFile((uchar*)ROMDUMP, 0x10000, SIZE_OF_ROMDUMP, 168);
 
 		nEnd = GetTickCount();
 		nRes = (nEnd - nStart) / 1000;
@@ -1263,56 +1765,339 @@ void DoDump(char *pszName)
 }
 
 
+/* Check a segment flashed to a bank, with the checksum stub - the Jag must be in */
+/* the BIOS, it is reset afterwards. Returns the number of flash blocks which differ */
+/* pDiffers, if not NULL, gets a flag per 64k block of the bank (DELTA_MAXBLOCKS) */
+int DoVerify(int nBank, const IMAGESEG *pSeg, uchar *pDiffers)
+{
+	uchar stub[SIZE_OF_VERIFYSTUB];
+	uchar table[FLASH_BANKSIZE / FLASH_BLOCKSIZE * 8];
+	unsigned long long tStart;
+	unsigned int nSum, nSumSum, nLong;
+	unsigned short nWord;
+	int nStart, nEnd, nAddr, nBlockStart, nBlockEnd, nPos, nTable, nByte, nBad;
+	bool bOldConsole, bOldNoBoot;
+
+	// the cart header space is not written, but by the second half of a 6MB image
+	nStart = ((1 == nBank) && (g_SixMegWrite)) ? FLASH_BASE : FLASH_BASE + 0x2000;
+	if (nStart < pSeg->base)
+	{
+		nStart = pSeg->base & ~15;
+	}
+	nEnd = (pSeg->base + pSeg->nLen + 15) & ~15;
+	if (nEnd > FLASH_BASE + FLASH_BANKSIZE)
+	{
+		nEnd = FLASH_BASE + FLASH_BANKSIZE;
+	}
+
+	if (NULL != pDiffers)
+	{
+		memset(pDiffers, 0, DELTA_MAXBLOCKS);
+	}
+
+	if (nEnd <= nStart)
+	{
+		return 0;
+	}
+
+	// the stub sums 16 bytes at a time, the flash around the segment is erased
+	memcpy(stub, VERIFYSTUB, SIZE_OF_VERIFYSTUB);
+	stub[VERIFYSTUB_BANK] = 0x4b;
+	stub[VERIFYSTUB_BANK + 1] = (1 == nBank) ? 0xa1 : 0xa0;
+	for (nByte = 0; nByte < 4; nByte++)
+	{
+		stub[VERIFYSTUB_START + nByte] = (uchar)(nStart >> (24 - nByte * 8));
+		stub[VERIFYSTUB_LENGTH + nByte] = (uchar)((nEnd - nStart) >> (24 - nByte * 8));
+	}
+
+	printf((NULL != pDiffers) ? "Reading the checksums of bank %d...\n" : "Verifying bank %d...\n", nBank + 1);
+	tStart = GetMicroCount();
+
+	// the flash stub is gone, the checksum stub is a plain program in RAM
+	bOldConsole = g_OptConsole;
+	bOldNoBoot = g_OptNoBoot;
+	g_OptConsole = false;
+	g_OptNoBoot = false;
+	g_OptFlashActive = false;
+	g_skipwait = true;		// it may be done before we look
+	DoFile(stub, VERIFYSTUB_BASE, SIZE_OF_VERIFYSTUB, 0);
+	g_skipwait = false;
+	g_OptConsole = bOldConsole;
+	g_OptNoBoot = bOldNoBoot;
+
+	// about 2 seconds for 4MB
+	if (!PollWord(0x1800 + 0xFEA, PollIsVerified, (nEnd - nStart) / 2000, 2000 + (nEnd - nStart) / 500, true, &nWord))
+	{
+		bye("Error: The checksum stub did not answer");
+	}
+
+	for (nTable = 0, nAddr = nStart; nAddr < nEnd; nTable += 8)
+	{
+		nAddr = (nAddr | (FLASH_BLOCKSIZE - 1)) + 1;
+	}
+
+	if (nWord != nTable)
+	{
+		bye("Error: The checksum stub answered with a wrong table length");
+	}
+
+	while (EZRead(0x1800, table, nTable) != nTable)
+	{
+		Reattach();
+	}
+	SwapBytes(table, table, nTable);
+
+	// the same sums over the segment, block by block
+	for (nBad = 0, nPos = 0, nAddr = nStart; nAddr < nEnd; nAddr = nBlockEnd, nPos += 8)
+	{
+		nBlockStart = nAddr;
+		nBlockEnd = (nAddr | (FLASH_BLOCKSIZE - 1)) + 1;
+		if (nBlockEnd > nEnd)
+		{
+			nBlockEnd = nEnd;
+		}
+
+		for (nSum = 0, nSumSum = 0; nAddr < nBlockEnd; nAddr += 4)
+		{
+			if ((nAddr >= pSeg->base) && (nAddr + 4 <= pSeg->base + pSeg->nLen))
+			{
+				nLong = ENBIGEND(pSeg->pData + nAddr - pSeg->base);
+			}
+			else
+			{
+				for (nLong = 0, nByte = nAddr; nByte < nAddr + 4; nByte++)
+				{
+					nLong = (nLong << 8) | (((nByte >= pSeg->base) && (nByte < pSeg->base + pSeg->nLen)) ? pSeg->pData[nByte - pSeg->base] : 0xff);
+				}
+			}
+
+			nSum += nLong;
+			nSumSum += nSum;
+		}
+
+		if ((nSum != ENBIGEND(table + nPos)) || (nSumSum != ENBIGEND(table + nPos + 4)))
+		{
+			// a delta flash expects them, only the count matters
+			if ((NULL == pDiffers) || (g_OptVerbose))
+			{
+				printf("* Flash block $%06X differs, from $%06X to $%06X\n", nBlockStart & ~(FLASH_BLOCKSIZE - 1), nBlockStart, nBlockEnd - 1);
+			}
+			if (NULL != pDiffers)
+			{
+				pDiffers[(nBlockStart - FLASH_BASE) / FLASH_BLOCKSIZE] = 1;
+			}
+			nBad++;
+		}
+	}
+
+	printf("%s %dKB of bank %d in %d ms, %s\n", (NULL != pDiffers) ? "Checked" : "Verified", (nEnd - nStart) / 1024, nBank + 1, (int)((GetMicroCount() - tStart) / 1000), nBad ? "the flash differs" : "no difference");
+
+	// the stub waits for a reset
+	DoResetAndReconnect(true);
+
+	return nBad;
+}
+
+
+/* qsort helper for the benchmark latencies */
+int CompareLatency(const void *a, const void *b)
+{
+	unsigned int nA = *(const unsigned int*)a;
+	unsigned int nB = *(const unsigned int*)b;
+
+	return (nA > nB) - (nA < nB);
+}
+
+
+/* One benchmark pass - erase (flash only), then upload without booting */
+void BenchRun(const char *pszTarget, uchar *pData, int base, int nLen)
+{
+	IMAGEINFO image;
+	unsigned long long tStart, tSetup, tEnd;
+	unsigned int nXfer, nMs;
+	int nRate, ez;
+
+	memset(&g_EZStats, 0, sizeof(g_EZStats));
+	g_nBenchLat = 0;
+
+	printf("\n%s benchmark, %d bytes at $%06X\n", pszTarget, nLen, base);
+	tStart = GetMicroCount();
+
+	if (g_OptDoFlash)
+	{
+		// like HandleTransfer, the flash program always has to boot
+		g_OptNoBoot = false;
+		ImageFromRange(&image, pData, base, nLen, 0);
+		DoFlash(&image);
+		g_OptFlashActive = true;
+	}
+
+	tSetup = GetMicroCount();
+
+	// no boot, there is nothing to run in the payload
+	g_OptNoBoot = true;
+	DoFile(pData, base, nLen, 0);
+
+	// the last blocks are only done once the Jag freed both buffers,
+	// the first polls are tight, the figures are not blurred by the backoff
+	for (ez = 0x1800; ez <= 0x2800; ez += 0x1000)
+	{
+		PollWord(ez + 0xFEA, PollIsFree, 0, 0, false, NULL);
+	}
+	tEnd = GetMicroCount();
+
+	g_OptNoBoot = false;
+	g_OptFlashActive = false;
+
+	nMs = (unsigned int)((tEnd - tSetup) / 1000);
+	nRate = (tEnd > tSetup) ? (int)(((unsigned long long)nLen * 1000000 / 1024) / (tEnd - tSetup)) : 0;
+	nXfer = g_EZStats.nReads + g_EZStats.nWrites + g_EZStats.nScans + g_EZStats.nBlocks;
+
+	printf("%s: transfer %u ms, %d KB/s", pszTarget, nMs, nRate);
+	if (g_OptDoFlash)
+	{
+		printf(" - erase %u ms, overall %d KB/s", (unsigned int)((tSetup - tStart) / 1000), (int)(((unsigned long long)nLen * 1000000 / 1024) / (tEnd - tStart)));
+	}
+	printf("\n");
+
+	if (g_nBenchLat > 0)
+	{
+		qsort(g_pBenchLat, g_nBenchLat, sizeof(unsigned int), CompareLatency);
+		printf("%s: %d blocks, latency (ms) p50 %.2f  p90 %.2f  p99 %.2f  max %.2f\n", pszTarget, g_nBenchLat,
+			g_pBenchLat[(g_nBenchLat - 1) * 50 / 100] / 1000.0, g_pBenchLat[(g_nBenchLat - 1) * 90 / 100] / 1000.0,
+			g_pBenchLat[(g_nBenchLat - 1) * 99 / 100] / 1000.0, g_pBenchLat[g_nBenchLat - 1] / 1000.0);
+	}
+
+	printf("%s: %u control transfers - %u reads, %u writes, %u queued blocks, %u scan codes\n", pszTarget, nXfer,
+		g_EZStats.nReads, g_EZStats.nWrites, g_EZStats.nBlocks, g_EZStats.nScans);
+
+	if (g_EZStats.nBadBlocks > 0)
+	{
+		printf("%s: %u blocks corrupted on the way, sent again\n", pszTarget, g_EZStats.nBadBlocks);
+	}
+
+	if ((g_EZStats.nRetries > 0) || (g_EZStats.nReconnects > 0) || (g_EZStats.nResent > 0))
+	{
+		printf("%s: %u transfers retried, %u reconnects, %u blocks sent again, %u ms lost\n", pszTarget, g_EZStats.nRetries, g_EZStats.nReconnects,
+			g_EZStats.nResent, g_EZStats.nDownMs);
+	}
+}
+
+
+/* Time the byte swap kernels over the payload, no Skunkboard involved */
+void BenchSwap(uchar *pData, int nLen)
+{
+	unsigned long long tStart, tVector, tScalar;
+	uchar *pOut;
+	int nPass, nPasses;
+
+	if (NULL == (pOut = (uchar*)malloc(nLen + 1)))
+	{
+		bye("Error: Not enough memory for the benchmark");
+	}
+
+	// enough passes over the payload for the timer to mean something
+	nPasses = (64 * 1024 * 1024) / nLen + 1;
+
+	tStart = GetMicroCount();
+	for (nPass = 0; nPass < nPasses; nPass++)
+	{
+		SwapBytes(pOut, pData, nLen);
+	}
+	tVector = GetMicroCount() - tStart + 1;
+
+	tStart = GetMicroCount();
+	for (nPass = 0; nPass < nPasses; nPass++)
+	{
+		SwapBytesScalar(pOut, pData, nLen);
+	}
+	tScalar = GetMicroCount() - tStart + 1;
+
+	printf("\nSwap: %s %d MB/s, scalar %d MB/s\n", g_pszSwapKernel,
+		(int)(((unsigned long long)nLen * nPasses) / tVector), (int)(((unsigned long long)nLen * nPasses) / tScalar));
+
+	free(pOut);
+}
+
+
+/* Push a synthetic payload through the regular upload path, to RAM, then to flash with -f */
+/* Note: the flash pass overwrites the bank content! */
+void DoBench(int nKB)
+{
+	uchar *pData;
+	unsigned int nSeed = 0x4a414755;
+	int nLen, nRamLen, nFlashLen;
+	int idx;
+	bool bDoFlash = g_OptDoFlash;
+
+	// keep it even, and within the targets
+	nLen = (nKB * 1024) & ~1;
+	nRamLen = (nLen > (0x200000 - 0x4000)) ? (0x200000 - 0x4000) : nLen;
+	nFlashLen = (nLen > (4 * 1024 * 1024 - 0x2000)) ? (4 * 1024 * 1024 - 0x2000) : nLen;
+
+	// pseudo random, so nothing along the way gets it cheaper than a real program
+	pData = (uchar*)malloc(nLen);
+	g_nBenchLatMax = nLen / 4064 + 2;
+	g_pBenchLat = (unsigned int*)malloc(g_nBenchLatMax * sizeof(unsigned int));
+	if ((NULL == pData) || (NULL == g_pBenchLat))
+	{
+		bye("Error: Not enough memory for the benchmark");
+	}
+
+	for (idx = 0; idx < nLen; idx++)
+	{
+		nSeed = nSeed * 1103515245 + 12345;
+		pData[idx] = (uchar)(nSeed >> 16);
+	}
+
+	if (!EZIsOpen())
+	{
+		findEZ(true, true);
+	}
+
+	printf("Benchmark through %s%s\n", g_pEZ->pszName, (g_pEZ == &EZSim) ? "" : " - make sure nothing runs on the Jaguar");
+
+	BenchSwap(pData, nLen);
+
+	g_OptDoFlash = false;
+	BenchRun("RAM", pData, 0x4000, nRamLen);
+
+	if (bDoFlash)
+	{
+		g_OptDoFlash = true;
+		BenchRun("Flash", pData, 0x802000, nFlashLen);
+	}
+
+	free(g_pBenchLat);
+	g_pBenchLat = NULL;
+	free(pData);
+}
+
+
 /* Request the Jaguar to print out serial number (uses the console to collect it) */
 void DoSerialInfo(void)
 {
 	unsigned char SerBuf[12];
 	unsigned short poll;
-    DWORD curtime,endtime;
 
 	// Open socket to Jaguar
-	if (NULL == udev)
+	if (!EZIsOpen())
 	{
-		udev = findEZ(true, true);
+		findEZ(true, true);
 	}
 
 	// On the newer boards, we can get this information without uploading a program, so try that first
 	// First, make sure that the $2800 buffer is marked as ready
-	endtime = GetTickCount() + 2000;
-
-	do
+	if (!PollWord(0x2800 + 0xFEA, PollIsReady, 0, 2000, true, &poll))
 	{
-		Spin();
-
-#ifdef LIBUSB_1
-		if (libusb_control_transfer(udev, 0xC0, 0xff, 4, 0x2800 + 0xFEA, (char*)&poll, 2, ComTimeout) != 2)
-#else
-		if (usb_control_msg(udev, 0xC0, 0xff, 4, 0x2800+0xFEA, (char*)&poll, 2, ComTimeout) != 2)
-#endif
-		{
-			Reattach();
-		}
-//			printf("Polled 0x%08x\n", poll);
-		// poll is unsigned. But a value over 0xf0xx is reserved for future use
-		// and we can't count on the lower bytes to be correct since the high
-		// byte can change first in rare race conditions.
-        curtime=GetTickCount();
-        if (curtime > endtime)
-		{
-            bye("Error: can't connect with skunkboard.");
-        }
+		bye("Error: can't connect with skunkboard.");
 	}
-	while (0xf0ff != (poll&0xf0ff));
 
 	if (poll == 0xffff)
 	{
 		// now, get the lower 12 bytes of that buffer - should contain the serial number
 		// If it fails, fall back on the old approach
-#ifdef LIBUSB_1
-		if (libusb_control_transfer(udev, 0xC0, 0xff, 4, 0x2800, (char*)SerBuf, 12, ComTimeout) == 12)
-#else
-		if (usb_control_msg(udev, 0xC0, 0xff, 4, 0x2800, (char*)SerBuf, 12, ComTimeout) == 12)
-#endif
+		if (EZRead(0x2800, SerBuf, 12) == 12)
 		{
 			// check for the magic word at the beginning (note the funky byte swapping!)
 			if (!memcmp(SerBuf, "\x57\xfa\x0d\xf0", 4))
@@ -1330,7 +2115,7 @@ void DoSerialInfo(void)
 	// This will make DoFile shell out to the console before returning
 	g_OptConsole = true;
 	g_OptSilentConsole = true;
-	DoFile((uchar*)DUMPVER, 0x5000, SIZE_OF_DUMPVER, 168, true);
+	DoFile((uchar*)DUMPVER, 0x5000, SIZE_OF_DUMPVER, 168);
 	printf("\n");
 }
 
@@ -1345,41 +2130,20 @@ void DoSerialBig(void)
 	int i;
 
 	// Open socket to Jaguar
-	if (NULL == udev)
+	if (!EZIsOpen())
 	{
-		udev = findEZ(true, true);
+		findEZ(true, true);
 	}
 
 	// On the newer boards, we can get this information without uploading a program, so try that first
 	// First, make sure that the $2800 buffer is marked as ready
-	do
-	{
-		Spin();
-
-#ifdef LIBUSB_1
-		if (libusb_control_transfer(udev, 0xC0, 0xff, 4, 0x2800 + 0xFEA, (char*)&poll, 2, ComTimeout) != 2)
-#else
-		if (usb_control_msg(udev, 0xC0, 0xff, 4, 0x2800+0xFEA, (char*)&poll, 2, ComTimeout) != 2)
-#endif
-		{
-			Reattach();
-		}
-//			printf("Polled 0x%08x\n", poll);
-		// poll is unsigned. But a value over 0xf0xx is reserved for future use
-		// and we can't count on the lower bytes to be correct since the high
-		// byte can change first in rare race conditions.
-	}
-	while (0xf0ff != (poll&0xf0ff));
+	PollWord(0x2800 + 0xFEA, PollIsReady, 0, 0, true, &poll);
 
 	if (poll == 0xffff)
 	{
 		// now, get the lower 12 bytes of that buffer - should contain the serial number
 		// If it fails, fall back on the old approach
-#ifdef LIBUSB_1
-		if (libusb_control_transfer(udev, 0xC0, 0xff, 4, 0x2800, (char*)SerBuf, 12, ComTimeout) == 12)
-#else
-		if (usb_control_msg(udev, 0xC0, 0xff, 4, 0x2800, (char*)SerBuf, 12, ComTimeout) == 12)
-#endif
+		if (EZRead(0x2800, SerBuf, 12) == 12)
 		{
 			// check for the magic word at the beginning (note the funky byte swapping!)
 			if (0 == memcmp(SerBuf, "\x57\xfa\x0d\xf0", 4)) 
@@ -1446,7 +2210,7 @@ void DoBiosUpdate(void)
 		printf("Examining current board...\n");
 		g_OptConsole=false;
 		g_skipwait=true;
-		DoFile((uchar*)readver, 0x5000, SIZE_OF_READVER, 168, true);
+		DoFile((uchar*)readver, 0x5000, SIZE_OF_READVER, 168);
 		g_skipwait=false;
 		Sleep(500);
 
@@ -1458,11 +2222,7 @@ void DoBiosUpdate(void)
 		// we don't check for the buffer again, because that doesn't work with the rev 1 board
 		// we delayed long enough above that all should be well.
 		// now, get the lower 12 bytes of that buffer - should contain the serial number
-#ifdef LIBUSB_1
-		if (libusb_control_transfer(udev, 0xC0, 0xff, 4, 0x2800, (char*)SerBuf, 12, ComTimeout) == 12)
-#else
-		if (usb_control_msg(udev, 0xC0, 0xff, 4, 0x2800, (char*)SerBuf, 12, ComTimeout) == 12)
-#endif
+		if (EZRead(0x2800, SerBuf, 12) == 12)
 		{
 			// check for the magic word at the beginning (note the funky byte swapping!)
 			if (0 == memcmp(SerBuf, "\x57\xfa\x0d\xf0", 4))
@@ -1526,7 +2286,7 @@ void DoBiosUpdate(void)
 		}
 
 		printf("\n\nGoing to upgrade Rev 1 board to 1.02.04\n\n");	
-		DoFile((uchar*)Upgrade10204, 0x80000, SIZE_OF_UPGRADE10204, 168, true);
+		DoFile((uchar*)Upgrade10204, 0x80000, SIZE_OF_UPGRADE10204, 168);
 #endif
 	}
 	else
@@ -1545,7 +2305,7 @@ void DoBiosUpdate(void)
 		}
 
 		printf("\n\nGoing to upgrade Rev %d board to Rev 3 BIOS 3.00.02 (okay for Rev2)\n\n", currentRev);
-		DoFile((uchar*)upgrayyd30002, 0x80000, SIZE_OF_UPGRAYYD30002, 168, true);
+		DoFile((uchar*)upgrayyd30002, 0x80000, SIZE_OF_UPGRAYYD30002, 168);
 #endif
 	}
 #else
@@ -1554,18 +2314,91 @@ void DoBiosUpdate(void)
 }
 
 
+/* The boot answer, 0 when started, 0x8888 when refused */
+bool PollIsBooted(unsigned short nWord)
+{
+	return (0 == nWord) || (0x8888 == nWord);
+}
+
+
+/* The checksum stub is done, the word is the length of its table (8 bytes a block) */
+bool PollIsVerified(unsigned short nWord)
+{
+	return (0 != nWord) && (nWord <= FLASH_BANKSIZE / FLASH_BLOCKSIZE * 8) && (0 == (nWord & 7));
+}
+
+
+/* Send a block that the Jag can't take before it is read back and checked */
+/* it is staged with no base and a free length, then the trailer is written */
+void WriteCheckedBlock(int ez, uchar *block)
+{
+	uchar trailer[12];
+	uchar check[4080];
+	unsigned int nCrc;
+	int nTry;
+
+	memcpy(trailer, block + 0xFE0, 12);
+	memset(block + 0xFE0, 0xff, 4);
+	block[0xFEA] = 0xff;
+	block[0xFEB] = 0xff;
+	nCrc = Crc32(0, block, 4080);
+
+	for (nTry = 0; ; nTry++)
+	{
+		if ((EZWrite(ez, block, 4080) != 4080) || (EZRead(ez, check, 4080) != 4080))
+		{
+			Reattach();
+			continue;
+		}
+
+		if (Crc32(0, check, 4080) == nCrc)
+		{
+			break;
+		}
+
+		g_EZStats.nBadBlocks++;
+
+		if (g_OptVerbose)
+		{
+			printf("Block to %04X corrupted, sent again\n", ez);
+		}
+
+		if (nTry >= CHECK_TRIES)
+		{
+			bye("Error: The blocks keep getting corrupted on the way to the Skunkboard.");
+		}
+	}
+
+	memcpy(block + 0xFE0, trailer, 12);
+
+	// one packet, the Jag sees the whole trailer or none of it
+	while (EZWrite(ez + 0xFE0, trailer, 12) != 12)
+	{
+		Reattach();
+
+		// a write reported failed may have made it, the base tells
+		if ((EZRead(ez + 0xFE0, check, 4) == 4) && !memcmp(check, trailer, 4))
+		{
+			break;
+		}
+	}
+}
+
+
 /* Writes a block to the Jaguar */
 /* uchar points to data to write, curbase is the base to load at, 
    start is the start address or -1 if not starting yet, and len
    is the number of bytes to load. len should be even or at least
    the buffer must be an even size!
    This function writes into the other-than-current block */
-void WriteABlock(uchar *data, int curbase, int start, int len)
+void WriteABlock(const uchar *data, int curbase, int start, int len)
 {
-	uchar block[4080];
-	int i;
-	volatile unsigned short poll;
-	DWORD curtime,endtime;
+	static unsigned short nSerial = 0;
+	uchar localblock[4080];
+	uchar *block = localblock;
+	unsigned short poll;
+	unsigned long long tBlock = GetMicroCount();
+	int nTry;
 
 	// check for cartridge header space
 	if ( ((curbase >= 0x800000) && (curbase < 0x802000)) ||	((curbase+len >= 0x800000) && (curbase+len < 0x802000)) )
@@ -1609,14 +2442,16 @@ void WriteABlock(uchar *data, int curbase, int start, int len)
 		}
 	}
 
+	// build the block straight into the next free transport block, while the previous one is still in flight
+	if (g_AsyncUpload)
+	{
+		block = EZGetBlock();
+	}
+
 	memset(block, 0, 4080);
 
 	// 'Fix' the byte order for the next block of file data
-	for (i = 0; i < len; i += 2)
-	{
-		block[i+1] = *data++;
-		block[i] = *data++;
-	}
+	SwapBytes(block, data, len);
 
 	// Set up block trailer
 	block[0xFE2] = curbase & 255;
@@ -1636,44 +2471,30 @@ void WriteABlock(uchar *data, int curbase, int start, int len)
 	block[0xFEA] = len & 255;
 	block[0xFEB] = (len >> 8) & 255;
 
+	// the console blocks all go to DUMMYBASE, only this tells them apart
+	nSerial++;
+	block[0xFEC] = nSerial & 255;
+	block[0xFED] = (nSerial >> 8) & 255;
+
 	if (g_OptVerbose)
 	{
 		printf("ez: %04x  start: %08x  len: %04x  base: %08x/%08x\n", nextez, ENMIDEND(block+0xfe4), HALFLITTLEEND(block+0xfea), ENMIDEND(block+0xfe0), curbase);
 	}
 
 	// Wait for the block to come free (handshake with 68K).
-	poll=0;
-	endtime = GetTickCount() + 2000;
-
-	do
+	// The Jag may be waiting for a block lost on the way, it's sent again
+	for (nTry = 0; !PollWord(nextez + 0xFEA, PollIsReady, 0, 2000, true, &poll); nTry++)
 	{
-		Spin();
-
-#ifdef LIBUSB_1
-		if (libusb_control_transfer(udev, 0xC0, 0xff, 4, nextez + 0xFEA, (char*)&poll, 2, ComTimeout) != 2)
-#else
-		if (usb_control_msg(udev, 0xC0, 0xff, 4, nextez+0xFEA, (char*)&poll, 2, ComTimeout) != 2)
-#endif
+		if ((nTry >= RESUME_TRIES) || (!ResumeRecover()))
 		{
-			Reattach();
+			bye("Error: can't connect with skunkboard");
 		}
-//			printf("Polled 0x%08x\n", poll);
-		// poll is unsigned. But a value over 0xf0xx is reserved for future use
-		// and we can't count on the lower bytes to be correct since the high
-		// byte can change first in rare race conditions.
-
-		curtime=GetTickCount();
-        if (curtime > endtime)
-		{
-            bye("Error: can't connect with skunkboard");
-        }
 	}
-	while (0xf0ff != (poll&0xf0ff));
 
-	// any value except 0xffff indicates a future use, possibly that
-	// this is a new firmware. We only need this here because this is
-	// always the first block sent to the Jaguar.
-	if (poll != 0xffff)
+	// any value except 0xffff indicates a future use: a newer BIOS telling
+	// its protocol level. We only need this here because this is always the
+	// first block sent to the Jaguar.
+	if ((poll != 0xffff) && (!CapsFromPoll(poll)))
 	{
 		if (g_OptVerbose)
 		{
@@ -1683,14 +2504,27 @@ void WriteABlock(uchar *data, int curbase, int start, int len)
 		bye("Error: Got invalid value from block synchronization. Please use a newer JCP.");
 	}
 
-	// Send off the finished block.
-#ifdef LIBUSB_1
-	if (libusb_control_transfer(udev, 0x40, 0xfe, 4080, nextez, (char*)block, 4080, ComTimeout) != 4080)
-#else
-	if (usb_control_msg(udev, 0x40, 0xfe, 4080, nextez, (char*)block, 4080, ComTimeout) != 4080)
-#endif
+	// Send off the finished block, a copy is kept until the buffer frees again
+	ResumeKeep(nextez, block);
+
+	if (g_OptCheckBlocks)
 	{
-		Reattach();
+		WriteCheckedBlock(nextez, block);
+	}
+	else if (g_AsyncUpload)
+	{
+		// queue it, and go prepare the next block while this one is moving
+		if (!EZQueueBlock(nextez, block))
+		{
+			ResumeRecover();
+		}
+	}
+	else
+	{
+		if (EZWrite(nextez, block, 4080) != 4080)
+		{
+			ResumeRecover();
+		}
 	}
 
 	// check for successful start, except for 'internal' utilities. These may
@@ -1702,22 +2536,13 @@ void WriteABlock(uchar *data, int curbase, int start, int len)
 		// Wait for the block to change to a valid setting (handshake with 68K).
 		poll=0;
 
-		do
+		// the boot block has to be on the Jag before we can watch for the answer
+		if (!EZFlush())
 		{
-			Spin();
-
-#ifdef LIBUSB_1
-			if (libusb_control_transfer(udev, 0xC0, 0xff, 4, nextez + 0xFEA, (char*)&poll, 2, ComTimeout) != 2)
-#else
-			if (usb_control_msg(udev, 0xC0, 0xff, 4, nextez+0xFEA, (char*)&poll, 2, ComTimeout) != 2)
-#endif
-			{
-				Reattach();
-			}
-
-//			printf("Polled 0x%08x\n", poll);
+			ResumeRecover();
 		}
-		while ((0x0000 != poll) && (0x8888 != poll));
+
+		PollWord(nextez + 0xFEA, PollIsBooted, 0, 0, true, &poll);
 
 		if (poll == 0x8888)
 		{
@@ -1731,123 +2556,370 @@ void WriteABlock(uchar *data, int curbase, int start, int len)
 			}
 		}
 	}
+
+	// benchmark bookkeeping - time for the block to be built, get a free buffer and be sent
+	if ((NULL != g_pBenchLat) && (g_nBenchLat < g_nBenchLatMax))
+	{
+		g_pBenchLat[g_nBenchLat++] = (unsigned int)(GetMicroCount() - tBlock);
+	}
 }
 
 
 /* Send a file to the Jaguar */
-void SendFile(int flen, uchar *fptr, int curbase, int base)
+/* the segments are sorted by address, the start request goes with the last block */
+void SendFile(const IMAGEINFO *pImage)
 {
+	const PREPIMAGE *pPrep;
+	int base = pImage->entry;
+	int nRun, nBlock;
 	int dotty=0;
+	int flen, curbase;
+	uchar gather[4064];
 	int len;
 	int start;
-	DWORD dummy;
+	int nSkipped = 0;
+
+	// the runs of blocks, usually ready since the Jag got ready
+	pPrep = PrepTake(pImage);
 
-	while (flen > 0)
+	ResumeForget();
+
+	g_AsyncUpload = true;
+
+	for (nBlock = 0, nRun = 0; nRun < pPrep->nRuns; nRun++)
 	{
-		start = (flen <= 4064) ? base : -1;
+		flen = pPrep->runs[nRun].nLen;
+		curbase = pPrep->runs[nRun].base;
 
-		if (-1 != start)
+		while (flen > 0)
 		{
-			if (g_OptNoBoot)
+			start = -1;
+
+			if ((flen <= 4064) && (nRun == pPrep->nRuns - 1))
 			{
-				if (g_OptFlashActive)
-				{
-					// flash technically can't no-boot, so this is the first half
-					// of a 6MB copy. Tell the flash program to return to cmd mode
-					start = -2;
-				}
-				else
-				{
-					// it really is no-boot
-					start = -1;
-				}
+				start = LastBlockStart(base);
+				dotty = 0;
+			}
+
+			len = (flen <= 4064) ? flen : 4064;
+
+			// programming 0xFF leaves the flash as it is, so those blocks don't need to travel,
+			// but the one carrying the start request
+			if ((g_OptFlashActive) && (-1 == start) && (pPrep->pBlank[nBlock]))
+			{
+				nSkipped++;
 			}
 			else
 			{
-				dotty = 0;
+				WriteABlock(PrepBlock(pPrep, curbase, len, gather), curbase, start, len);
+			}
 
-				if (g_OptVerbose)
-				{
-					printf(" \nBooting address $%X\n", start);
-				}
-				else
-				{
-					printf(" \n");
-				}
+			curbase += 4064;
+			flen -= 4064;
+			nBlock++;
+
+			dotty = (dotty + 1) & 7;
+
+			if ((0 == dotty) && (!g_OptQuietMode)) 
+			{
+				putchar('.');
+			}
+		}
+	}
+
+	if ((nSkipped) && (g_OptVerbose))
+	{
+		printf(" \nSkipped %d blocks of 0xFF\n", nSkipped);
+	}
+
+	EndUpload();
+}
+
+
+/* Send an image while the input is still arriving, each block as soon as it is there */
+/* returns the number of bytes sent, known at the end of the input only */
+int SendStream(const IMAGEINFO *pImage)
+{
+	static uchar zeros[4064];
+	const IMAGESEG *pSeg = &pImage->segs[0];
+	int nPos = (int)(pSeg->pData - fdata);
+	int nEnd = nPos + pSeg->nLen;
+	int curbase = pSeg->base;
+	int nAvail, nData, len, start;
+	int nSent = 0;
+	int dotty = 0;
+	uchar *fptr;
+
+	ResumeForget();
+	g_AsyncUpload = true;
+
+	for (;;)
+	{
+		// a byte past the block tells if it is the last one
+		nAvail = InputMore((nEnd - nPos > 4064) ? (nPos + 4065) : nEnd);
+
+		if (nAvail >= nEnd)
+		{
+			nAvail = nEnd;
+		}
+		else if ((InputComplete()) && (IMAGE_ABS == pImage->nFormat))
+		{
+			// the header announced more, the rest is loaded as zeros like for a file
+			nAvail = nEnd;
+		}
+
+		if (nAvail <= nPos)
+		{
+			break;
+		}
+
+		len = (nAvail - nPos > 4064) ? 4064 : (nAvail - nPos);
+		nData = InputMore(0);
+
+		if (nPos + len <= nData)
+		{
+			fptr = fdata + nPos;
+		}
+		else
+		{
+			// past the end of the data, the end of it and the zeros may share a block
+			memset(zeros, 0, sizeof(zeros));
+			if (nData > nPos)
+			{
+				memcpy(zeros, fdata + nPos, nData - nPos);
+			}
+			fptr = zeros;
+		}
+
+		start = -1;
+
+		if (nPos + len >= nAvail)
+		{
+			start = LastBlockStart(pImage->entry);
+			dotty = 0;
+		}
+
+		WriteABlock(fptr, curbase, start, len);
+
+		nPos += len;
+		curbase += len;
+		nSent += len;
+
+		dotty = (dotty + 1) & 7;
+
+		if ((0 == dotty) && (!g_OptQuietMode)) 
+		{
+			putchar('.');
+		}
+
+		if (-1 != start)
+		{
+			break;
+		}
+	}
+
+	EndUpload();
+
+	return nSent;
+}
+
+
+/* Start request carried by the last block of an upload */
+/* none for a no-boot upload, and the bank modifiers while flashing */
+int LastBlockStart(int base)
+{
+	int start = base;
+
+	if (g_OptNoBoot)
+	{
+		if (g_OptFlashActive)
+		{
+			// flash technically can't no-boot, so this is the first half
+			// of a 6MB copy. Tell the flash program to return to cmd mode
+			start = -2;
+		}
+		else
+		{
+			// it really is no-boot
+			start = -1;
+		}
+	}
+	else
+	{
+		if (g_OptVerbose)
+		{
+			printf(" \nBooting address $%X\n", start);
+		}
+		else
+		{
+			printf(" \n");
+		}
+
+		/* add modifiers only when the flash is proceeding */
+		if ((g_OptFlashActive)||(g_OptOnlyBoot))
+		{
+			if (nCartBank == 1)
+			{
+				start|=0x10000000;		// set bank 2
+			}
+			if (nCartBank == -1)
+			{
+				start|=0x70000000;		// set 6MB mode (signed, avoid high bit)
+			}
+		}
+	}
+
+	return start;
+}
+
+
+/* Wrap up an upload, the Jag must be listening at $2800 when it's done */
+void EndUpload(void)
+{
+	DWORD dummy;
+
+	// if this is a no-boot case, we need to make sure the next block will
+	// be at $2800, as that's the only address jcp polls to start up. So
+	// if needed, we'll send a little dummy block here, like with -b
+	if ((g_OptNoBoot) && (nextez != 0x1800))
+	{
+		dummy = 0;
+		WriteABlock((unsigned char*)&dummy, DUMMYBASE, -1, 4);
+	}
+
+	// make sure everything queued has left the host before anyone else talks to the Jag
+	if (!EZFlush())
+	{
+		ResumeRecover();
+	}
+
+	g_AsyncUpload = false;
+}
+
+
+/* Let an image of an input still arriving be sent as it comes */
+/* only a single range to the RAM can be, the segment then runs up to the end of the RAM, */
+/* or to the length announced by the header */
+bool StreamImage(IMAGEINFO *pImage)
+{
+	IMAGESEG *pSeg = &pImage->segs[0];
+
+	if ((g_OptDoFlash) || (g_OptOnlyBoot) || (1 != pImage->nSegs) || (pSeg->base < 0) || (pSeg->base >= RAMBUFSIZE))
+	{
+		return false;
+	}
+
+	if (IMAGE_ABS != pImage->nFormat)
+	{
+		pSeg->nLen = RAMBUFSIZE - pSeg->base;
+		pImage->flen = pImage->skip + pSeg->nLen;
+	}
+	else if (pSeg->base + pSeg->nLen + pSeg->nZero > RAMBUFSIZE)
+	{
+		return false;
+	}
+
+	pImage->bStream = true;
+	return true;
+}
 
-				/* add modifiers only when the flash is proceeding */
-				if ((g_OptFlashActive)||(g_OptOnlyBoot))
-				{
-					if (nCartBank == 1)
-					{
-						start|=0x10000000;		// set bank 2
-					}
-					if (nCartBank == -1)
-					{
-						start|=0x70000000;		// set 6MB mode (signed, avoid high bit)
-					}
-				}
-			}
-		}
 
-		len = (flen <= 4064) ? flen : 4064;
+/* Insert a segment in an image, sorted by address */
+/* returns false if there are too many, or if it overlaps another one */
+bool AddSegment(IMAGEINFO *pImage, int base, uchar *pData, int nLen, int nZero)
+{
+	IMAGESEG *pSegs = pImage->segs;
+	int idx;
 
-		WriteABlock(fptr, curbase, start, len);
+	if (pImage->nSegs >= MAX_SEGMENTS)
+	{
+		return false;
+	}
 
-		fptr += 4064;
-		curbase += 4064;
-		flen -= 4064;
+	for (idx = pImage->nSegs; (idx > 0) && (pSegs[idx-1].base > base); idx--)
+	{
+		pSegs[idx] = pSegs[idx-1];
+	}
 
-		dotty = (dotty + 1) & 7;
+	pSegs[idx].base = base;
+	pSegs[idx].pData = pData;
+	pSegs[idx].nLen = nLen;
+	pSegs[idx].nZero = nZero;
+	pImage->nSegs++;
 
-		if ((0 == dotty) && (!g_OptQuietMode)) 
-		{
-			putchar('.');
-		}
+	if (((idx > 0) && (pSegs[idx-1].base + pSegs[idx-1].nLen + pSegs[idx-1].nZero > base)) ||
+		((idx < pImage->nSegs - 1) && (base + nLen + nZero > pSegs[idx+1].base)))
+	{
+		return false;
 	}
 
-	// if this is a no-boot case, we need to make sure the next block will
-	// be at $2800, as that's the only address jcp polls to start up. So
-	// if needed, we'll send a little dummy block here, like with -b
-	if ((g_OptNoBoot) && (nextez != 0x1800))
+	return true;
+}
+
+
+/* Trim the first half of a 6MB image down to what's needed, the end of the first bank */
+/* returns the length to send - a cart image is a single segment */
+int SixMegTrim(IMAGEINFO *pImage)
+{
+	int flen = pImage->flen - pImage->skip;
+
+	if ((pImage->base+flen) >= 0xc00000)
 	{
-		dummy = 0;
-		WriteABlock((unsigned char*)&dummy, DUMMYBASE, -1, 4);
+		flen -= (pImage->base+flen)-0xc00000;
+		pImage->segs[0].nLen = flen;
 	}
+
+	return flen;
+}
+
+
+/* Make an image of flen bytes from fdata, with a skip bytes header, to load and start at base */
+void ImageFromRange(IMAGEINFO *pImage, uchar *fdata, int base, int flen, int skip)
+{
+	pImage->nFormat = IMAGE_RAW;
+	pImage->base = base;
+	pImage->entry = base;
+	pImage->skip = skip;
+	pImage->flen = flen;
+	pImage->nSegs = 1;
+	pImage->segs[0].base = base;
+	pImage->segs[0].pData = fdata + skip;
+	pImage->segs[0].nLen = (flen > skip) ? (flen - skip) : 0;
+	pImage->segs[0].nZero = 0;
+	pImage->bStream = false;
 }
 
 
-/* Parse a file for headers, and prepare to send it to the Jaguar */
+/* Send a builtin file, or a raw range, to the Jaguar */
 /* returns the number of bytes processed including headers */
 /* note: builtin files DO NOT autodetect - make sure your base and */
 /* skip values are correct! (You can run the file manually to get them) */
-int DoFile(uchar *fdata, int base, int flen, int skip, bool builtin)
+int DoFile(uchar *fdata, int base, int flen, int skip)
+{
+	IMAGEINFO image;
+
+	ImageFromRange(&image, fdata, base, flen, skip);
+
+	return DoImage(&image);
+}
+
+
+/* Send a parsed image to the Jaguar, 4064 bytes at a time */
+/* returns the number of bytes processed including headers */
+int DoImage(const IMAGEINFO *pImage)
 {
-	// Send the data to the Jaguar, 4064 bytes at a time
-	int curbase;
+	static DWORD nDummy = 0;
+	IMAGEINFO image = *pImage;
 	int ticks, oldlen;
 	int nRet = 0;
-	uchar *fptr;
+	int flen;
 	int res;
 
 	if (!g_OptOnlyBoot)
 	{
-		if (!builtin)
-		{
-			// this one mutes so we don't print the info twice
-			DetermineFileInfo(true, fdata, &base, &flen, &skip);
-		
-			if (g_HeaderSkip > 0)
-			{
-				printf("Forcing a manual header skip of %d bytes (was %d)\n", g_HeaderSkip, skip);
-				skip = g_HeaderSkip;
-			}
-		}
-
-		curbase = base;
-		flen -= skip;
+		flen = image.flen - image.skip;
 
-		if ((base >= 0x800000) || (base+flen >= 0x800000))
+		if ((image.base >= 0x800000) || (image.base+flen >= 0x800000))
 		{
 			if ((!g_OptDoFlash) && (!g_OptOverrideFlash))
 			{
@@ -1858,7 +2930,7 @@ int DoFile(uchar *fdata, int base, int flen, int skip, bool builtin)
 
 				/* if the exe was renamed, then we WILL do flash */
 				g_OptDoFlash = true;
-				DoFlash(flen+skip);
+				DoFlash(&image);
 				g_OptFlashActive = true;
 			}
 		}
@@ -1866,19 +2938,20 @@ int DoFile(uchar *fdata, int base, int flen, int skip, bool builtin)
 	else
 	{
 		// the only-boot mode, we send a dummy block to the top of unused ROM space and then boot the address
-		curbase = DUMMYBASE;
-		flen = 4;		// smallest transfer size
-		skip = 0;
+		image.skip = 0;
+		image.nSegs = 1;
+		image.segs[0].base = DUMMYBASE;
+		image.segs[0].pData = (uchar*)&nDummy;
+		image.segs[0].nLen = flen = 4;		// smallest transfer size
+		image.segs[0].nZero = 0;
 	}
 
-	fptr = fdata + skip;
-
 	// Open socket to Jaguar
 
 
-	if (NULL == udev)
+	if (!EZIsOpen())
 	{
-		udev = findEZ(true, true);
+		findEZ(true, true);
 	}
 
 	/* if this is the first file, and we are in auto mode, check if reset is needed */
@@ -1901,15 +2974,20 @@ int DoFile(uchar *fdata, int base, int flen, int skip, bool builtin)
 		printf("Sending...");
 		if ((g_SixMegWrite) && (!g_OptOnlyBoot)) 
 		{
-			if ((curbase+flen) >= 0xc00000)
-			{
-				// trim it down and only send what's needed
-				flen -= (curbase+flen)-0xc00000;
-			}
+			flen = SixMegTrim(&image);
+		}
+
+		if (image.bStream)
+		{
+			// the length is known once the input has ended
+			oldlen = flen = SendStream(&image);
+		}
+		else
+		{
+			SendFile(&image);
 		}
 
-		nRet = flen+skip;
-		SendFile(flen, fptr, curbase, base);
+		nRet = flen+image.skip;
 	}
 
 	if (!g_OptOnlyBoot)
@@ -1948,189 +3026,41 @@ void bye(char* msg)
 		printf("* %s\n", msg);
 	}
 
-	if (NULL != udev)
+	// the daemon carries on with the next job, with the Skunkboard still open
+	if (g_InDaemonJob)
 	{
-#ifdef LIBUSB_1
-		libusb_close(udev);
-#else
-		usb_close(udev);
-#endif
+		g_AsyncUpload = false;
+		EZFlush();
+		longjmp(g_DaemonJmp, 1);
 	}
 
-	if (NULL != fdata)
+	if (EZIsOpen())
 	{
-		free(fdata);
+		EZClose();
 	}
 
+	PrepDiscard();
+	InputClose();
+
 	exit(1);
 }
 
 
-/* Locate the Jaguar on the USB bus, open it, get a handle, and upload the turboW tool */
-#ifdef LIBUSB_1
-libusb_device_handle *findEZ(bool fInstallTurbo, bool fAbortOnFail)
-#else
-usb_dev_handle *findEZ(bool fInstallTurbo, bool fAbortOnFail)
-#endif
-{	
-#ifdef LIBUSB_1
-	libusb_device_handle *udev = NULL;
-	struct libusb_device_descriptor desc;
-	libusb_device **devlist;
-	libusb_device *device;
-	uint8_t PortList[256];
-	ssize_t cnt;
-	unsigned char SerBuf[12];
-
-	if ((cnt = libusb_get_device_list(ctx, &devlist)) >= 0)
+/* Locate the Jaguar, open it, get a handle, and upload the turboW tool */
+bool findEZ(bool fInstallTurbo, bool fAbortOnFail)
+{
+	if (EZOpen(fInstallTurbo))
 	{
-		for (ssize_t i = 0; i < cnt; i++)
-		{
-			device = devlist[i];
-
-			if (!USBBus || (libusb_get_bus_number(device) == USBBus))
-			{
-				int j = libusb_get_port_numbers(device, PortList, sizeof(PortList));
-
-				while (j--)
-				{
-					if (!USBPort || (PortList[j] == USBPort))
-					{
-						if (!libusb_get_device_descriptor(device, &desc))
-						{
-							if ((desc.idVendor == 0x4b4) && (desc.idProduct == 0x7200))
-							{
-								if (!libusb_open(device, &udev))
-								{
-									if (!SkunkboardSerial || ((libusb_control_transfer(udev, 0xC0, 0xff, 4, 0x2800, (char*)SerBuf, 12, ComTimeout) == 12) && (SerBuf[8] == (SkunkboardSerial & 0x00ff)) && (SerBuf[9] == ((SkunkboardSerial & 0xff00) >> 8))))
-									{
-										if (fInstallTurbo)
-										{
-											// load turbow from array
-											if (libusb_control_transfer(udev, 0x40, 0xff, 0, 0x304c, (char*)turbow, SIZE_OF_TURBOW, ComTimeout) != SIZE_OF_TURBOW)
-											{
-												printf("Failed to install turbow.bin!\n");
-											}
-											else
-											{
-												if (g_OptVerbose)
-												{
-													printf("Installed turbow.bin\n");
-												}
-											}
-										}
-
-										return udev;
-									}
-									else
-									{
-										libusb_close(udev);
-									}
-								}
-								else
-								{
-									bye("Error: Skunkboard found, but can't open EZ-HOST. In use or not ready? ");
-								}
-							}
-						}
-					}
-				}
-			}
-		}
-
-		libusb_free_device_list(devlist, 1);
+		return true;
 	}
-#else
-	usb_dev_handle *udev = NULL;
-	struct usb_bus *bus;
-	struct usb_device *dev;
-	int nTriesLeft = 3;
-	int ret;
-	unsigned char SerBuf[12];
-
-	while (nTriesLeft--) 
-	{
-		usb_init();
-		usb_set_debug(0);
-		usb_find_busses();
-		usb_find_devices();
-
-		for (bus = usb_get_busses(); bus; bus = bus->next)
-		{
-			if (!strlen(USBBusName) || !strcmp(USBBusName, bus->dirname))
-			{
-				for (dev = bus->devices; dev; dev = dev->next)
-				{
-					if ((dev->descriptor.idVendor == 0x4b4) && (dev->descriptor.idProduct == 0x7200))
-					{
-						if (!(udev = usb_open(dev)))
-						{
-							bye("Error: - Found, but can't open, EZ-HOST. In use or not ready? ");
-//							udev = NULL;
-//							break;		/* should quickly fall out of outer loop too, unless there's another! */
-						}
-						else
-						{
-							if (!SkunkboardSerial || ((usb_control_msg(udev, 0xC0, 0xff, 4, 0x2800, (char*)SerBuf, 12, ComTimeout) == 12) && (SerBuf[8] == (SkunkboardSerial & 0x00ff)) && (SerBuf[9] == ((SkunkboardSerial & 0xff00)>>8))))
-							{
-								if (fInstallTurbo)
-								{
-									// load turbow from array
-									ret = usb_control_msg(udev, 0x40, 0xff, 0, 0x304c, (char*)turbow, SIZE_OF_TURBOW, ComTimeout);
-
-									if (ret < 1)
-									{
-										printf("Failed to install turbow.bin!\n");
-									}
-									else
-									{
-										if (g_OptVerbose)
-										{
-											printf("Installed turbow.bin: %d scan codes sent\n", ret);
-										}
-									}
-								}
-
-								return udev;
-							}
-							else
-							{
-								usb_close(udev);
-								udev = NULL;
-							}
-						}
-					}
-				}
-			}
-		}
 
-		if (udev == NULL)
-		{
-			if (nTriesLeft > 0)
-			{
-				printf(".. retrying ..\n");
-				Sleep(1000);
-			}
-		}
-	}
-#endif
 	if (fAbortOnFail)
 	{
 		bye("Error: Can't open EZ-HOST.\n");
 		// does not return
 	}
 
-	return NULL;
-}
-
-
-/* called from a failed attempt to access the jag */
-void Reattach(void)
-{
-	printf("Waiting to handshake with 68k (control-c to abort)\n");
-	udev=NULL;
-	Sleep(1000);
-	udev = findEZ(true, true);
+	return false;
 }
 
 
@@ -2142,18 +3072,23 @@ void HandleConsole(void)
 	char buf[4064];
 	int nLength;
 	int nDummy;
+	int i;
 #endif
 	uchar block[4080];
 	unsigned short tmp;
-	int i, len;
+	int len;
 #ifdef WIN32
 	char *p, *oldp;
 #endif
-	int x;
 
 	// If the user requested an external console, then we just have to shell out to it here
 	if (strlen(g_pszExtShell))
 	{
+		if (g_InDaemonJob)
+		{
+			bye("Error: External console is not available through the daemon");
+		}
+
 		printf(" \nStarting external console...\n");
 		if (-1 == _execlp(g_pszExtShell, g_pszExtShell, NULL))
 		{
@@ -2193,27 +3128,22 @@ void HandleConsole(void)
 	block[0xFEA] = 0xff;
 	block[0xFEB] = 0xff;
 
+	// the mailbox is cleared first, the Jag won't use it before the buffers
+	MboxReset();
+
 	// to handshake with the jaguar, we clear the blocks from this end
 	// that way the Jag knows we're up and ready.
 	tmp = 0xffff;
 
 	for (;;)
 	{
-#ifdef LIBUSB_1
-		if (libusb_control_transfer(udev, 0x40, 0xfe, 4080, 0x1800 + 0xFEA, (char*)&tmp, 2, ComTimeout) != 2)
-#else
-		if (usb_control_msg(udev, 0x40, 0xfe, 4080, 0x1800+0xFEA, (char*)&tmp, 2, ComTimeout) != 2)
-#endif
+		if (EZWrite(0x1800 + 0xFEA, &tmp, 2) != 2)
 		{
 			Reattach();
 		}
 		else
 		{
-#ifdef LIBUSB_1
-			if (libusb_control_transfer(udev, 0x40, 0xfe, 4080, 0x2800 + 0xFEA, (char*)&tmp, 2, ComTimeout) != 2)
-#else
-			if (usb_control_msg(udev, 0x40, 0xfe, 4080, 0x2800 + 0xFEA, (char*)&tmp, 2, ComTimeout) != 2)
-#endif
+			if (EZWrite(0x2800 + 0xFEA, &tmp, 2) != 2)
 			{
 				Reattach();
 			}
@@ -2228,33 +3158,45 @@ void HandleConsole(void)
 	for (;;)
 	{
 		// Wait for the block to be used (handshake with 68K).
-		volatile short poll=0;
+		unsigned short poll=0xffff;
+		POLLER idle;
+
+		PollStart(&idle, 0, false);
 
-		do 
+		for (;;)
 		{
 			nextez = (0x1800 == nextez) ? 0x2800 : 0x1800;
 
 			// It's actually faster to check this small block and
 			// do two reads than to read the whole block just to test
-#ifdef LIBUSB_1
-			if (libusb_control_transfer(udev, 0xC0, 0xff, 4, nextez + 0xFEA, (char*)&poll, 2, ComTimeout) != 2)
-#else
-			if (usb_control_msg(udev, 0xC0, 0xff, 4, nextez+0xFEA, (char*)&poll, 2, ComTimeout) != 2)
-#endif
+			if (EZRead(nextez + 0xFEA, &poll, 2) != 2)
 			{
 				Reattach();
 			}
+			else if (0xffff != poll)
+			{
+				break;
+			}
+
+			// a console can wait for hours, back off once both are seen free
+			// and the mailbox is empty
+			if (0x2800 == nextez)
+			{
+				if (MboxService())
+				{
+					PollBusy(&idle);
+				}
+				else
+				{
+					PollIdle(&idle);
+				}
+			}
 		}
-		while (-1 == poll);
 
 		// Read in the finished block.
 		for (;;)
 		{
-#ifdef LIBUSB_1
-			if (libusb_control_transfer(udev, 0xC0, 0xff, 4080, nextez, (char*)block, 4080, ComTimeout) == 4080)
-#else
-			if (usb_control_msg(udev, 0xC0, 0xff, 4080, nextez, (char*)block, 4080, ComTimeout) == 4080)
-#endif
+			if (EZRead(nextez, block, 4080) == 4080)
 			{
 				break;
 			}
@@ -2267,11 +3209,7 @@ void HandleConsole(void)
 
 		for (;;)
 		{
-#ifdef LIBUSB_1
-			if (libusb_control_transfer(udev, 0x40, 0xfe, 4080, nextez + 0xFEA, (char*)&tmp, 2, ComTimeout) == 2)
-#else
-			if (usb_control_msg(udev, 0x40, 0xfe, 4080, nextez+0xFEA, (char*)&tmp, 2, ComTimeout) == 2)
-#endif
+			if (EZWrite(nextez + 0xFEA, &tmp, 2) == 2)
 			{
 				break;
 			}
@@ -2280,12 +3218,7 @@ void HandleConsole(void)
 		}
 
 		// deswap the block (including the header)
-		for (i=0; i<4080; i+=2)
-		{
-			x = block[i+1];
-			block[i+1] = block[i];
-			block[i] = x;
-		}
+		SwapBytes(block, block, 4080);
 
 		if (g_OptVerbose) 
 		{
@@ -2357,31 +3290,14 @@ void HandleConsole(void)
 
 					// now we must not proceed from this point until the Jaguar
 					// acknowledges that block by clearing its length
-					do 
-					{
-#ifdef LIBUSB_1
-						if (libusb_control_transfer(udev, 0xC0, 0xff, 4, nextez + 0xFEA, (char*)&poll, 2, ComTimeout) != 2)
-#else
-						if (usb_control_msg(udev, 0xC0, 0xff, 4, nextez+0xFEA, (char*)&poll, 2, ComTimeout) != 2)
-#endif
-						{
-							Reattach();
-						}
-
-						Sleep(500);
-					}
-					while (0 != poll);
+					PollWord(nextez + 0xFEA, PollIsZero, 0, 0, false, NULL);
 
 					// Now clear the buffer back to 0xffff so the Jag can use it again
 					tmp  =0xffff;
 
 					for (;;)
 					{
-#ifdef LIBUSB_1
-						if (libusb_control_transfer(udev, 0x40, 0xfe, 4080, nextez + 0xFEA, (char*)&tmp, 2, ComTimeout) == 2)
-#else
-						if (usb_control_msg(udev, 0x40, 0xfe, 4080, nextez+0xFEA, (char*)&tmp, 2, ComTimeout) == 2)
-#endif
+						if (EZWrite(nextez + 0xFEA, &tmp, 2) == 2)
 						{
 							break;
 						}
@@ -2521,28 +3437,13 @@ void HandleConsole(void)
 
 					// now we must not proceed from this point until the Jaguar
 					// acknowledges that block by clearing its length
-					do
-					{
-#ifdef LIBUSB_1
-						if (libusb_control_transfer(udev, 0xC0, 0xff, 4, nextez + 0xFEA, (char*)&poll, 2, ComTimeout) != 2)
-#else
-						if (usb_control_msg(udev, 0xC0, 0xff, 4, nextez+0xFEA, (char*)&poll, 2, ComTimeout) != 2)
-#endif
-						{
-							Reattach();
-						}
-					}
-					while (0 != poll);
+					PollWord(nextez + 0xFEA, PollIsZero, 0, 0, false, NULL);
 
 					// Now clear the buffer back to 0xffff so the Jag can use it again
 					tmp = 0xffff;
 					for (;;)
 					{
-#ifdef LIBUSB_1
-						if (libusb_control_transfer(udev, 0x40, 0xfe, 4080, nextez + 0xFEA, (char*)&tmp, 2, ComTimeout) == 2)
-#else
-						if (usb_control_msg(udev, 0x40, 0xfe, 4080, nextez+0xFEA, (char*)&tmp, 2, ComTimeout) == 2)
-#endif
+						if (EZWrite(nextez + 0xFEA, &tmp, 2) == 2)
 						{
 							break;
 						}
@@ -2577,28 +3478,13 @@ void HandleConsole(void)
 
 						// now we must not proceed from this point until the Jaguar
 						// acknowledges that block by clearing its length
-						do
-						{
-#ifdef LIBUSB_1
-							if (libusb_control_transfer(udev, 0xC0, 0xff, 4, nextez + 0xFEA, (char*)&poll, 2, ComTimeout) != 2)
-#else
-							if ((usb_control_msg(udev, 0xC0, 0xff, 4, nextez + 0xFEA, (char*)&poll, 2, ComTimeout) != 2))
-#endif
-							{
-								Reattach();
-							}
-						}
-						while (0 != poll);
+						PollWord(nextez + 0xFEA, PollIsZero, 0, 0, false, NULL);
 
 						// Now clear the buffer back to 0xffff so the Jag can use it again
 						tmp = 0xffff;
 						for (;;)
 						{
-#ifdef LIBUSB_1
-							if (libusb_control_transfer(udev, 0x40, 0xfe, 4080, nextez + 0xFEA, (char*)&tmp, 2, ComTimeout) == 2)
-#else
-							if (usb_control_msg(udev, 0x40, 0xfe, 4080, nextez + 0xFEA, (char*)&tmp, 2, ComTimeout) == 2)
-#endif
+							if (EZWrite(nextez + 0xFEA, &tmp, 2) == 2)
 							{
 								break;
 							}
@@ -2736,15 +3622,24 @@ void CatVal(char *szOut, int nBufLen, int nVal, int nRow)
 // may still be changed even if false is returned!
 // Will only set values to absolute settings (ie: it must be safe
 // to call this function multiple times with updated values)
-bool DetermineFileInfo(bool bMute, uchar *fdata, int *base, int *flen, int *skip)
+bool DetermineFileInfo(bool bMute, uchar *fdata, int flen, int base, IMAGEINFO *pImage)
 {
 	bool ret = true;	// assume it will be true
 	char *pTmp;
 	int fPadded;
 	int idx, nFirst;
+	int nFormat;
+	int nFileLen = flen;
+
+	pImage->nFormat = IMAGE_RAW;
+	pImage->base = base;
+	pImage->skip = 0;
+	pImage->flen = flen;
+	pImage->nSegs = 0;
+	pImage->bStream = false;
 
 	// Check file header
-	if ((*flen > 0x2000) && (0x802000 == ENBIGEND(fdata+0x404)))
+	if ((pImage->flen > 0x2000) && (0x802000 == ENBIGEND(fdata+0x404)))
 	{
 		if (!bMute)
 		{
@@ -2754,35 +3649,41 @@ bool DetermineFileInfo(bool bMute, uchar *fdata, int *base, int *flen, int *skip
 			}
 		}
 
+		pImage->nFormat = IMAGE_CART;
+
 		if (!g_OptOverride)
 		{
-			*base = 0x802000;
+			pImage->base = 0x802000;
 		}
 
-		*skip = 0x2000;
-	} else if ((*flen > 0x2200) && (0x802000 == ENBIGEND(fdata+0x604))) {
+		pImage->skip = 0x2000;
+	} else if ((pImage->flen > 0x2200) && (0x802000 == ENBIGEND(fdata+0x604))) {
 		if (!bMute) {
 			if ( (g_OptVerbose) || (!g_OptSilentConsole) ) {
 				printf("Cart ROM + 512:  ");
 			}
 		}
-		if (!g_OptOverride) *base = 0x802000;
-		*skip = 0x2200;
-	} else if ((*flen > 72) && (fdata[0] == 0x01) && (fdata[1] == 0x50)) {
+		pImage->nFormat = IMAGE_CART;
+		if (!g_OptOverride) pImage->base = 0x802000;
+		pImage->skip = 0x2200;
+	} else if ((pImage->flen > 72) && (fdata[0] == 0x01) && (fdata[1] == 0x50)) {
 		if (!bMute) {
 			if ( (g_OptVerbose) || (!g_OptSilentConsole) ) {
 				printf("COFF File:  ");
 			}
 		}
-		if (!g_OptOverride) *base = ENBIGEND(fdata+56);
-		*skip = ENBIGEND(fdata+68);
-		if (*flen <= *skip) {
+		pImage->nFormat = IMAGE_COFF;
+		if (!g_OptOverride) pImage->base = ENBIGEND(fdata+56);
+		pImage->skip = ENBIGEND(fdata+68);
+		if (pImage->flen <= pImage->skip) {
 			bye("Error: Detection error or corrupt file.\n");
 		}
-	} else if ((*flen > 0x30) && (fdata[0] == 0x7f) && (fdata[1] == 'E') && (fdata[2] == 'L') && (fdata[3] == 'F')) {
-		int loadbase;
-		int secs, seclen;
-		uchar *img, *secptr;
+	} else if ((pImage->flen > 0x34) && (fdata[0] == 0x7f) && (fdata[1] == 'E') && (fdata[2] == 'L') && (fdata[3] == 'F')) {
+		int entry, lowest, highest;
+		int nHdrs, nHdrLen, nType;
+		int sadr, slen, smem, soff;
+		uchar *hdrptr;
+		bool bProgram, bLoad;
 
 		if (!bMute)
 		{
@@ -2797,55 +3698,101 @@ bool DetermineFileInfo(bool bMute, uchar *fdata, int *base, int *flen, int *skip
 			bye("Error: Not 68K executable.");
 		}
 
-		*skip = loadbase = ENBIGEND(fdata+0x18);
-		*flen = 0;
-	
-		// Map all the sections into a new memory image. Not necessarily entirely safe.
-		secs = HALFBIGEND(fdata+0x30);
-		seclen = HALFBIGEND(fdata+0x2e);
-		img = (uchar*)malloc(RAMBUFSIZE);
-		secptr = fdata+ENBIGEND(fdata+0x20);
-		memset(img, 0, 2048*1024);
-		while (secs-- >= 0) {
-			int sadr = ENBIGEND(secptr+0xc), slen = ENBIGEND(secptr+0x14);
-			uchar* fptr = fdata+ENBIGEND(secptr+0x10);
-			if (0 != sadr) {		// 0 is debug info, so ignore it
-				if (sadr < loadbase)
-					bye("Error: Section has base address below entry point.  See readelf for details.");
-				if (sadr+slen > *flen)
-					*flen = sadr+slen;
-				if (*flen >= 2048*1024 || loadbase < 0)
+		pImage->nFormat = IMAGE_ELF;
+		entry = ENBIGEND(fdata+0x18);
+
+		// the headers may be anywhere in the file, wait for all of it
+		if (!InputComplete())
+		{
+			pImage->flen = InputMore(BUFSIZE);
+		}
+
+		// the loadable segments, or the allocated sections for the files without program headers
+		bProgram = (HALFBIGEND(fdata+0x2c) > 0);
+		if (bProgram)
+		{
+			nHdrs = HALFBIGEND(fdata+0x2c);
+			nHdrLen = HALFBIGEND(fdata+0x2a);
+			hdrptr = fdata+ENBIGEND(fdata+0x1c);
+		}
+		else
+		{
+			nHdrs = HALFBIGEND(fdata+0x30);
+			nHdrLen = HALFBIGEND(fdata+0x2e);
+			hdrptr = fdata+ENBIGEND(fdata+0x20);
+		}
+
+		while (nHdrs-- > 0) {
+			if ((hdrptr < fdata) || (hdrptr + nHdrLen > fdata + pImage->flen))
+				bye("Error: Detection error or corrupt file.\n");
+			if (bProgram) {
+				// PT_LOAD, filesz bytes then zeros up to memsz
+				bLoad = (1 == ENBIGEND(hdrptr));
+				soff = ENBIGEND(hdrptr+0x4);
+				sadr = ENBIGEND(hdrptr+0xc);
+				slen = ENBIGEND(hdrptr+0x10);
+				smem = ENBIGEND(hdrptr+0x14);
+			} else {
+				// progbits copied, nobits zeroed, and address 0 is debug info, so ignore it
+				nType = ENBIGEND(hdrptr+0x4);
+				sadr = ENBIGEND(hdrptr+0xc);
+				bLoad = (0 != sadr) && ((1 == nType) || (8 == nType));
+				soff = ENBIGEND(hdrptr+0x10);
+				smem = ENBIGEND(hdrptr+0x14);
+				slen = (1 == nType) ? smem : 0;
+			}
+			if ((bLoad) && (smem > 0)) {
+				if ((sadr < 0) || (slen < 0) || (smem < slen) || (sadr+smem > RAMBUFSIZE))
 					bye("Error: Section falls outside Jaguar memory.  See readelf for details.");
-				if (1 == ENBIGEND(secptr+0x4))	// Progbits, so copy them
-					memcpy(img+sadr, fptr, slen);
+				if ((soff < 0) || (soff+slen > pImage->flen))
+					bye("Error: Detection error or corrupt file.\n");
+				if (!AddSegment(pImage, sadr, fdata+soff, slen, smem-slen))
+					bye("Error: Too many sections, or overlapping ones.  See readelf for details.");
 			}
-			secptr+=seclen;
+			hdrptr+=nHdrLen;
 		}
-		// copy the data across to the true buffer
-		memcpy(fdata, img, RAMBUFSIZE);
-		free(img);
-		if (!g_OptOverride) *base=loadbase;
-	} else if ((*flen > 0x2e) && (fdata[0x1c] == 'J') && (fdata[0x1d] == 'A') && (fdata[0x1e] == 'G') && (fdata[0x1f] == 'R')) {
+
+		if (!pImage->nSegs)
+			bye("Error: Nothing to load in the ELF file.");
+
+		// the segments move along with the start address if it is overridden
+		if (g_OptOverride) {
+			for (idx = 0; idx < pImage->nSegs; idx++)
+				pImage->segs[idx].base += base - entry;
+			entry = base;
+		}
+
+		lowest = pImage->segs[0].base;
+		highest = pImage->segs[pImage->nSegs-1].base + pImage->segs[pImage->nSegs-1].nLen + pImage->segs[pImage->nSegs-1].nZero;
+
+		// the segments are uploaded as they are, the length is their span for the checks
+		pImage->skip = 0;
+		pImage->flen = highest - lowest;
+		pImage->base = lowest;
+		pImage->entry = entry;
+	} else if ((pImage->flen > 0x2e) && (fdata[0x1c] == 'J') && (fdata[0x1d] == 'A') && (fdata[0x1e] == 'G') && (fdata[0x1f] == 'R')) {
 		if (!bMute) {
 			if ( (g_OptVerbose) || (!g_OptSilentConsole) ) {
 				printf("Jag Server Exe: ");
 			}
 		}
-		if (!g_OptOverride) *base=ENBIGEND(fdata+0x22);
-		*skip=0x2e;
-	} else if ((*flen > 0x24) && (fdata[0] == 0x60) && (fdata[1] == 0x1b)) {
+		pImage->nFormat = IMAGE_JAGSERVER;
+		if (!g_OptOverride) pImage->base=ENBIGEND(fdata+0x22);
+		pImage->skip=0x2e;
+	} else if ((pImage->flen > 0x24) && (fdata[0] == 0x60) && (fdata[1] == 0x1b)) {
 		if (!bMute) {
 			if ( (g_OptVerbose) || (!g_OptSilentConsole) ) {
 				printf("DRI ABS File:  ");
 			}
 		}
-		*skip = 0x24;
-		*base = ENBIGEND(fdata+0x16);
-		*flen = ENBIGEND(fdata+0x6) + ENBIGEND(fdata+0x2) + *skip;
+		pImage->nFormat = IMAGE_ABS;
+		pImage->skip = 0x24;
+		pImage->base = ENBIGEND(fdata+0x16);
+		pImage->flen = ENBIGEND(fdata+0x6) + ENBIGEND(fdata+0x2) + pImage->skip;
 	}
 	else
 	{
-		if ((*flen > 0xa8) && (fdata[0] == 0x01) && (fdata[1] == 0x50))
+		if ((pImage->flen > 0xa8) && (fdata[0] == 0x01) && (fdata[1] == 0x50))
 		{
 			if (!bMute)
 			{
@@ -2855,10 +3802,12 @@ bool DetermineFileInfo(bool bMute, uchar *fdata, int *base, int *flen, int *skip
 				}
 			}
 
-			*skip = 0xa8;
-			*base = ENBIGEND(fdata + 0x28);		// Right now, the code below assumes base = run address.
+			pImage->nFormat = IMAGE_ABS;
+
+			pImage->skip = 0xa8;
+			pImage->base = ENBIGEND(fdata + 0x28);		// Right now, the code below assumes base = run address.
 			// run = ENBIGEND(fdata + 0x24);	// But these files can have different run and base addresses.
-			*flen = ENBIGEND(fdata + 0x18) + ENBIGEND(fdata + 0x1c) + *skip;
+			pImage->flen = ENBIGEND(fdata + 0x18) + ENBIGEND(fdata + 0x1c) + pImage->skip;
 		}
 		else
 		{
@@ -2866,7 +3815,7 @@ bool DetermineFileInfo(bool bMute, uchar *fdata, int *base, int *flen, int *skip
 			// skip the first 8 bytes as some vendors put data there
 			fPadded = false;
 
-			if (*flen > 0x2000)
+			if (pImage->flen > 0x2000)
 			{
 				nFirst = fdata[8];
 
@@ -2895,12 +3844,14 @@ bool DetermineFileInfo(bool bMute, uchar *fdata, int *base, int *flen, int *skip
 					}
 				}
 
+				pImage->nFormat = IMAGE_CART;
+
 				if (!g_OptOverride)
 				{
-					*base = 0x802000;
+					pImage->base = 0x802000;
 				}
 
-				*skip = 0x2000;
+				pImage->skip = 0x2000;
 			}
 			else
 			{
@@ -2916,7 +3867,7 @@ bool DetermineFileInfo(bool bMute, uchar *fdata, int *base, int *flen, int *skip
 							if (!bMute)
 							{
 								// check for exact multiple of 2MB or 4MB, and warn user if so
-								if ((*flen == (1024 * 1024 * 2)) || (*flen == (1024 * 1024 * 4)))
+								if ((pImage->flen == (1024 * 1024 * 2)) || (pImage->flen == (1024 * 1024 * 4)))
 								{
 									printf("Warning: ROM size is suspicious but no common header found. Full file being uploaded.\nIf it fails, consider adding '-h 8192' to skip a 2k header\n\n");
 								}
@@ -2927,10 +3878,10 @@ bool DetermineFileInfo(bool bMute, uchar *fdata, int *base, int *flen, int *skip
 
 						if (!g_OptOverride)
 						{
-							*base = 0x802000;
+							pImage->base = 0x802000;
 						}
 
-						*skip = 0;
+						pImage->skip = 0;
 					}
 				}
 
@@ -2939,11 +3890,42 @@ bool DetermineFileInfo(bool bMute, uchar *fdata, int *base, int *flen, int *skip
 		}
 	}
 
+	// all but the ELF files are a single segment, after the header
+	if (IMAGE_ELF != pImage->nFormat)
+	{
+		if (g_HeaderSkip > 0)
+		{
+			if (!bMute)
+			{
+				printf("Forcing a manual header skip of %d bytes (was %d)\n", g_HeaderSkip, pImage->skip);
+			}
+			pImage->skip = g_HeaderSkip;
+		}
+
+		nFormat = pImage->nFormat;
+		ImageFromRange(pImage, fdata, pImage->base, pImage->flen, pImage->skip);
+		pImage->nFormat = nFormat;
+
+		// a header may announce more than the file holds, the rest is loaded as zeros
+		if ((pImage->flen > nFileLen) && (InputComplete()))
+		{
+			pImage->segs[0].nLen = (nFileLen > pImage->skip) ? (nFileLen - pImage->skip) : 0;
+			pImage->segs[0].nZero = pImage->flen - pImage->skip - pImage->segs[0].nLen;
+		}
+	}
+
 	if (!bMute) 
 	{
 		if ( (g_OptVerbose) || (!g_OptSilentConsole) )
 		{
-			printf("Skip %d bytes, base addr is $%X, length is %d bytes\n", *skip, *base, *flen-*skip);
+			if ((InputComplete()) || (IMAGE_ABS == pImage->nFormat))
+			{
+				printf("Skip %d bytes, base addr is $%X, length is %d bytes\n", pImage->skip, pImage->entry, pImage->flen-pImage->skip);
+			}
+			else
+			{
+				printf("Skip %d bytes, base addr is $%X, length not known yet\n", pImage->skip, pImage->entry);
+			}
 		}
 	}
 
@@ -0,0 +1,82 @@
+#ifndef __JCP2_H
+#define __JCP2_H
+
+/* Definitions shared between the jcp2 modules */
+
+#ifndef uchar
+#define uchar unsigned char
+#endif
+#ifndef bool
+#define bool int
+#endif
+#ifndef true
+#define true 1
+#endif
+#ifndef false
+#define false 0
+#endif
+
+#if !defined(WIN32) && !defined(WIN64)
+/* linux compatibility with Windows terms */
+#define DWORD unsigned int
+#define _stricmp strcasecmp
+#define Sleep(x) usleep(x*1000)
+#define _execlp execlp
+
+DWORD GetTickCount();
+#endif
+
+/* flash geometry - the stub erases a bank by 64k blocks, from its start */
+#define FLASH_BASE			0x800000
+#define FLASH_BANKSIZE		(4 * 1024 * 1024)
+#define FLASH_BLOCKSIZE		0x10000
+#define FLASH_MAXBLOCKS		62
+
+/* a part of an image to upload: nLen bytes from pData, then nZero zeros, at base */
+typedef struct
+{
+	int base;
+	uchar *pData;
+	int nLen;
+	int nZero;
+} IMAGESEG;
+
+#define MAX_SEGMENTS		64
+
+/* file formats, as found by DetermineFileInfo */
+#define IMAGE_RAW			0		/* no header found, or a builtin file */
+#define IMAGE_CART			1		/* cart ROM, with or without its header */
+#define IMAGE_COFF			2
+#define IMAGE_ELF			3
+#define IMAGE_JAGSERVER		4
+#define IMAGE_ABS			5		/* DRI or Alcyon */
+
+/* a file parsed once, and handed down to the transfer functions as it is */
+typedef struct
+{
+	int nFormat;
+	int base;				/* lowest load address */
+	int entry;				/* start address */
+	int skip;				/* header length */
+	int flen;				/* file length, header included (the span of the segments for an ELF file) */
+	int nSegs;
+	IMAGESEG segs[MAX_SEGMENTS];	/* sorted by address */
+	bool bStream;			/* the input is still arriving, the single segment ends with it */
+} IMAGEINFO;
+
+/* microseconds counter, for the finer timings */
+unsigned long long GetMicroCount(void);
+
+void bye(char* msg);
+void Spin(void);
+void Reattach(void);
+
+/* globals */
+extern char USBBusName[10];
+extern int USBBus;
+extern int USBPort;
+extern unsigned short SkunkboardSerial;
+extern int ComTimeout;
+extern bool g_OptVerbose;
+
+#endif
@@ -0,0 +1,110 @@
+/* jcp_bss.c : BSS clearing on the Jag
+
+	The COFF and ELF images carry the size of their BSS, and it used to be
+	sent as zeros, at the USB rate. The zeros now stay on the PC: the data
+	of the segments is sent without booting, then the clearing stub
+	(bssstub.h) with the list of the zero ranges, which clears them and
+	starts the image. The stub runs after the last block, so nothing sent
+	lands in a cleared range afterwards.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "jcp2.h"
+#include "jcp_rle.h"
+#include "jcp_bss.h"
+#include "bssstub.h"
+
+
+/* The image without the zeros after its segments, the segments of zeros only are left out */
+/* returns false if there are too few zeros for it to pay */
+bool BssSplit(const IMAGEINFO *pImage, IMAGEINFO *pData)
+{
+	int nSeg, nZero = 0;
+
+	*pData = *pImage;
+	pData->nSegs = 0;
+
+	for (nSeg = 0; nSeg < pImage->nSegs; nSeg++)
+	{
+		nZero += pImage->segs[nSeg].nZero;
+
+		if (pImage->segs[nSeg].nLen > 0)
+		{
+			pData->segs[pData->nSegs] = pImage->segs[nSeg];
+			pData->segs[pData->nSegs].nZero = 0;
+			pData->nSegs++;
+		}
+	}
+
+	return (nZero >= BSS_MINZERO) && (pData->nSegs > 0);
+}
+
+
+/* Build the stub and the list of the zero ranges of an image, the caller frees *ppBlob */
+/* returns its length, to send and start at *pBase, or 0 if there is no room above the image */
+int BssBuild(const IMAGEINFO *pImage, uchar **ppBlob, int *pBase)
+{
+	const IMAGESEG *pSeg;
+	uchar *pBlob;
+	int nSeg, nBlob, nBase, nByte, nStart;
+	int nEnd = 0;
+
+	*ppBlob = NULL;
+
+	pBlob = (uchar*)malloc(SIZE_OF_BSSSTUB + (pImage->nSegs + 1) * 8);
+	if (NULL == pBlob)
+	{
+		bye("Error: Out of memory for the BSS clearing");
+	}
+
+	memcpy(pBlob, BSSSTUB, SIZE_OF_BSSSTUB);
+	for (nByte = 0; nByte < 4; nByte++)
+	{
+		pBlob[BSSSTUB_ENTRY + nByte] = (uchar)(pImage->entry >> (24 - nByte * 8));
+	}
+
+	// a start and a length a range, then a 0 length
+	nBlob = SIZE_OF_BSSSTUB;
+	for (nSeg = 0; nSeg < pImage->nSegs; nSeg++)
+	{
+		pSeg = &pImage->segs[nSeg];
+		nStart = pSeg->base + pSeg->nLen;
+
+		if (nEnd < nStart + pSeg->nZero)
+		{
+			nEnd = nStart + pSeg->nZero;
+		}
+
+		if (pSeg->nZero > 0)
+		{
+			for (nByte = 0; nByte < 4; nByte++)
+			{
+				pBlob[nBlob + nByte] = (uchar)(nStart >> (24 - nByte * 8));
+				pBlob[nBlob + 4 + nByte] = (uchar)(pSeg->nZero >> (24 - nByte * 8));
+			}
+			nBlob += 8;
+		}
+	}
+	memset(pBlob + nBlob, 0, 8);
+	nBlob += 8;
+
+	nBase = (RLE_TOP - nBlob) & ~15;
+
+	if (g_OptVerbose)
+	{
+		printf("BSS: %d ranges, stub at $%06X\n", (nBlob - SIZE_OF_BSSSTUB) / 8 - 1, nBase);
+	}
+
+	if ((pImage->base <= 0x2800) || (nEnd > nBase))
+	{
+		free(pBlob);
+		return 0;
+	}
+
+	*ppBlob = pBlob;
+	*pBase = nBase;
+
+	return nBlob;
+}
@@ -0,0 +1,14 @@
+#ifndef __JCP_BSS_H
+#define __JCP_BSS_H
+
+/* BSS clearing: the zeros after the segments of a RAM image are not sent,
+   the stub of bssstub.h clears them on the Jag, then starts the image. The
+   stub and its list of ranges are placed in the free RAM above the image,
+   below RLE_TOP, like the decompressor stub. */
+
+#define BSS_MINZERO			4064		/* less than a block is sent as it is */
+
+bool BssSplit(const IMAGEINFO *pImage, IMAGEINFO *pData);	/* the image without its zeros, false if there are too few */
+int BssBuild(const IMAGEINFO *pImage, uchar **ppBlob, int *pBase);	/* stub and ranges to send at *pBase, 0 if it does not fit */
+
+#endif
@@ -0,0 +1,35 @@
+/* jcp_caps.c : protocol level detection
+
+	The block synchronization stops on any free buffer word other than
+	0xFFFF ("Please use a newer JCP"): the FxFF values are kept for future
+	BIOSs, but nothing said what they mean.
+
+	They now carry the protocol level of the BIOS, 0xFnFF for level n+1,
+	which jcp2 reports, and a BIOS above the level of jcp2 is still refused.
+	Only level 0 exists so far, the 4064 bytes blocks in two buffers every
+	BIOS takes: this is detection only, there is no other mode to switch to,
+	and nothing for jcp2 to tell the BIOS.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "jcp2.h"
+#include "jcp_caps.h"
+
+int g_BiosLevel = 0;
+
+
+/* The level of the BIOS, from the length word of a free buffer */
+/* returns false if it is above the one of jcp2 */
+bool CapsFromPoll(unsigned short nWord)
+{
+	g_BiosLevel = (0xffff == nWord) ? 0 : ((nWord >> 8) & 0x0f) + 1;
+
+	if (g_OptVerbose)
+	{
+		printf("Protocol level %d (jcp2 %d)\n", g_BiosLevel, CAPS_LEVEL);
+	}
+
+	return (g_BiosLevel <= CAPS_LEVEL);
+}
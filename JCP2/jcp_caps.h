@@ -0,0 +1,15 @@
+#ifndef __JCP_CAPS_H
+#define __JCP_CAPS_H
+
+/* Protocol level detection: jcp2 learns the level of the BIOS from the
+   buffer length words, where a free buffer reads 0xFFFF (level 0, all
+   the BIOSs so far) or 0xFnFF (level n+1). A BIOS above the level of
+   jcp2 is refused. */
+
+#define CAPS_LEVEL			0			/* the level jcp2 speaks: 4064 bytes blocks, two buffers */
+
+extern int g_BiosLevel;					/* as the BIOS announced it */
+
+bool CapsFromPoll(unsigned short nWord);	/* the level of the BIOS from a free buffer word, false if jcp2 can't speak it */
+
+#endif
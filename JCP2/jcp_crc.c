@@ -0,0 +1,37 @@
+/* jcp_crc.c : CRC-32 of the blocks read back (--check) */
+
+#include "jcp2.h"
+#include "jcp_crc.h"
+
+static unsigned int CrcTable[256];
+static bool bCrcTable = false;
+
+
+/* reflected 0x04C11DB7, one byte at a time */
+unsigned int Crc32(unsigned int nCrc, const uchar *pBuf, int nLen)
+{
+	unsigned int c;
+	int n, k;
+
+	if (!bCrcTable)
+	{
+		for (n = 0; n < 256; n++)
+		{
+			c = (unsigned int)n;
+			for (k = 0; k < 8; k++)
+			{
+				c = (c & 1) ? (0xEDB88320 ^ (c >> 1)) : (c >> 1);
+			}
+			CrcTable[n] = c;
+		}
+		bCrcTable = true;
+	}
+
+	nCrc = ~nCrc;
+	while (nLen-- > 0)
+	{
+		nCrc = CrcTable[(nCrc ^ *pBuf++) & 0xff] ^ (nCrc >> 8);
+	}
+
+	return ~nCrc;
+}
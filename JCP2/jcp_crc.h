@@ -0,0 +1,7 @@
+#ifndef __JCP_CRC_H
+#define __JCP_CRC_H
+
+/* CRC-32 (the zip one), start with 0 and chain the calls for the following data */
+unsigned int Crc32(unsigned int nCrc, const uchar *pBuf, int nLen);
+
+#endif
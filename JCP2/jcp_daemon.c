@@ -0,0 +1,445 @@
+/* jcp_daemon.c : daemon mode and its thin client
+
+	The daemon owns the Skunkboard: the USB library, the device lookup and
+	the turbow upload are done once, then each client command line runs as
+	a job with the standard input and outputs of the client, passed along
+	with the request.
+
+	Unix sockets only, the Windows builds report the mode as unavailable.
+
+	The client hands its terminal over, so both ends only talk to the same
+	user (the peer credentials of the socket), and the default socket is in
+	$XDG_RUNTIME_DIR, or in a /tmp/jcp2-<uid> directory only the user can
+	enter, never at a path another user could take first.
+*/
+
+#if !defined(WIN32) && !defined(WIN64)
+#define _GNU_SOURCE			/* struct ucred */
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "jcp2.h"
+#include "jcp_daemon.h"
+
+#if defined(WIN32) || defined(WIN64)
+
+int DaemonServe(const char *pszSocket, DAEMONJOB pfnJob)
+{
+	printf("The daemon mode is not available in this build\n");
+	return 1;
+}
+
+
+int DaemonClient(const char *pszSocket, int argc, char* argv[])
+{
+	printf("* Error: The daemon mode is not available in this build\n");
+	return 1;
+}
+
+#else
+
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#define DAEMON_MAXREQUEST	8192
+#define DAEMON_MAXARGS		64
+
+
+/* The private directory of the default socket, when there is no $XDG_RUNTIME_DIR */
+/* returns false if it can't be made, or someone else can get in */
+static bool PrivateDir(const char *pszDir, bool bCreate)
+{
+	struct stat st;
+
+	if (bCreate)
+	{
+		mkdir(pszDir, S_IRWXU);
+	}
+
+	if (lstat(pszDir, &st) < 0)
+	{
+		return false;
+	}
+
+	return (S_ISDIR(st.st_mode)) && (st.st_uid == getuid()) && (0 == (st.st_mode & (S_IRWXG | S_IRWXO)));
+}
+
+
+/* Socket path, one per user by default */
+/* returns false if the default one is not safe to use */
+static bool SocketName(struct sockaddr_un *pAddr, const char *pszSocket, bool bCreate)
+{
+	const char *pszRuntime = getenv("XDG_RUNTIME_DIR");
+	char szDir[64];
+
+	memset(pAddr, 0, sizeof(struct sockaddr_un));
+	pAddr->sun_family = AF_UNIX;
+
+	if (pszSocket[0])
+	{
+		strncpy(pAddr->sun_path, pszSocket, sizeof(pAddr->sun_path) - 1);
+	}
+	else if ((NULL != pszRuntime) && (pszRuntime[0]) && (strlen(pszRuntime) + 11 < sizeof(pAddr->sun_path)))
+	{
+		snprintf(pAddr->sun_path, sizeof(pAddr->sun_path), "%s/jcp2.sock", pszRuntime);
+	}
+	else
+	{
+		snprintf(szDir, sizeof(szDir), "/tmp/jcp2-%d", (int)getuid());
+		snprintf(pAddr->sun_path, sizeof(pAddr->sun_path), "%s/jcp2.sock", szDir);
+
+		if (!PrivateDir(szDir, bCreate))
+		{
+			printf("* Error: '%s' is not a directory of yours only\n", szDir);
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+/* Is the other end of the socket run by the same user */
+static bool PeerIsUs(int nSock)
+{
+#if defined(SO_PEERCRED)
+	struct ucred cred;
+	socklen_t nLen = sizeof(cred);
+
+	if (getsockopt(nSock, SOL_SOCKET, SO_PEERCRED, &cred, &nLen) < 0)
+	{
+		return false;
+	}
+
+	return (cred.uid == getuid());
+#else
+	uid_t uid;
+	gid_t gid;
+
+	if (getpeereid(nSock, &uid, &gid) < 0)
+	{
+		return false;
+	}
+
+	return (uid == getuid());
+#endif
+}
+
+
+/* Send the whole buffer */
+static bool SendAll(int nSock, const char *pBuf, int nLen)
+{
+	int nRet;
+
+	while (nLen > 0)
+	{
+		if ((nRet = (int)write(nSock, pBuf, nLen)) <= 0)
+		{
+			if ((nRet < 0) && (EINTR == errno))
+			{
+				continue;
+			}
+
+			return false;
+		}
+
+		pBuf += nRet;
+		nLen -= nRet;
+	}
+
+	return true;
+}
+
+
+/* Get the client standard input and outputs */
+static bool ReadStdFiles(int nSock, int *pFd)
+{
+	struct msghdr msg;
+	struct cmsghdr *cmsg;
+	struct iovec iov;
+	char cTag;
+	char ctrl[CMSG_SPACE(3 * sizeof(int))];
+
+	memset(&msg, 0, sizeof(msg));
+	iov.iov_base = &cTag;
+	iov.iov_len = 1;
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = ctrl;
+	msg.msg_controllen = sizeof(ctrl);
+
+	if (recvmsg(nSock, &msg, 0) != 1)
+	{
+		return false;
+	}
+
+	cmsg = CMSG_FIRSTHDR(&msg);
+	if ((NULL == cmsg) || (SOL_SOCKET != cmsg->cmsg_level) || (SCM_RIGHTS != cmsg->cmsg_type) || (cmsg->cmsg_len != CMSG_LEN(3 * sizeof(int))))
+	{
+		return false;
+	}
+
+	memcpy(pFd, CMSG_DATA(cmsg), 3 * sizeof(int));
+	return true;
+}
+
+
+/* Get the client request, and split it - argv[0] is the working directory */
+static int ReadRequest(int nSock, char *pBuf, char **argv)
+{
+	int nLen = 0;
+	int nRet, argc, idx;
+
+	// read until the empty string closing the list
+	for (;;)
+	{
+		if (nLen == DAEMON_MAXREQUEST)
+		{
+			return 0;
+		}
+
+		if ((nRet = (int)read(nSock, pBuf + nLen, 1)) <= 0)
+		{
+			return 0;
+		}
+
+		if ((++nLen > 1) && !pBuf[nLen - 1] && !pBuf[nLen - 2])
+		{
+			break;
+		}
+	}
+
+	for (argc = 0, idx = 0; (idx < nLen - 1) && (argc < DAEMON_MAXARGS); argc++)
+	{
+		argv[argc] = pBuf + idx;
+		idx += (int)strlen(pBuf + idx) + 1;
+	}
+
+	return argc;
+}
+
+
+/* Accept the clients forever, and run their jobs one at a time */
+int DaemonServe(const char *pszSocket, DAEMONJOB pfnJob)
+{
+	struct sockaddr_un addr;
+	int nListen, nClient;
+	int nStdIn, nStdOut, nStdErr;
+	int argc, nRet, nFd[3];
+	char *argv[DAEMON_MAXARGS];
+	char szRequest[DAEMON_MAXREQUEST];
+	char szHome[1024];
+	char cEnd;
+	mode_t nMask;
+
+	if (!SocketName(&addr, pszSocket, true))
+	{
+		return 1;
+	}
+
+	// a vanished client must not take the daemon along
+	signal(SIGPIPE, SIG_IGN);
+
+	if ((nListen = socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
+	{
+		printf("Can't create the daemon socket, error %d\n", errno);
+		return 1;
+	}
+
+	// a previous daemon may have left its socket behind
+	unlink(addr.sun_path);
+
+	// the socket is created for the user only, not opened up by the umask until a chmod
+	nMask = umask(S_IRWXG | S_IRWXO | S_IXUSR);
+	nRet = bind(nListen, (struct sockaddr*)&addr, sizeof(addr));
+	umask(nMask);
+
+	if ((nRet < 0) || (listen(nListen, 4) < 0))
+	{
+		printf("Can't listen on '%s', error %d\n", addr.sun_path, errno);
+		close(nListen);
+		return 1;
+	}
+
+	if (NULL == getcwd(szHome, sizeof(szHome)))
+	{
+		strcpy(szHome, "/");
+	}
+
+	printf("Daemon listening on '%s'\n", addr.sun_path);
+	fflush(stdout);
+
+	// the console input is read as the Jaguar asks for it, keep nothing for the next client
+	setvbuf(stdin, NULL, _IONBF, 0);
+	setvbuf(stdout, NULL, _IOLBF, 0);
+
+	nStdIn = dup(0);
+	nStdOut = dup(1);
+	nStdErr = dup(2);
+
+	for (;;)
+	{
+		if ((nClient = accept(nListen, NULL, NULL)) < 0)
+		{
+			if (EINTR == errno)
+			{
+				continue;
+			}
+
+			printf("Daemon failed to accept a client, error %d\n", errno);
+			break;
+		}
+
+		// another user gets nothing run, on the Skunkboard or with our files
+		if ((!PeerIsUs(nClient)) || (!ReadStdFiles(nClient, nFd)))
+		{
+			close(nClient);
+			continue;
+		}
+
+		if (((argc = ReadRequest(nClient, szRequest, argv)) > 0) && !chdir(argv[0]))
+		{
+			// the job talks to the client
+			fflush(stdout);
+			fflush(stderr);
+			dup2(nFd[0], 0);
+			dup2(nFd[1], 1);
+			dup2(nFd[2], 2);
+			clearerr(stdin);
+
+			// argv[0] becomes the program name again
+			argv[0] = "jcp2";
+			nRet = pfnJob(argc, argv);
+
+			fflush(stdout);
+			fflush(stderr);
+			dup2(nStdIn, 0);
+			dup2(nStdOut, 1);
+			dup2(nStdErr, 2);
+			clearerr(stdin);
+
+			cEnd = (char)nRet;
+			SendAll(nClient, &cEnd, 1);
+
+			if (chdir(szHome))
+			{
+				printf("Daemon can't go back to '%s'\n", szHome);
+			}
+		}
+		else
+		{
+			SendAll(nFd[1], "* Error: Bad request\n", 21);
+			SendAll(nClient, "\1", 1);
+		}
+
+		close(nFd[0]);
+		close(nFd[1]);
+		close(nFd[2]);
+		close(nClient);
+	}
+
+	close(nListen);
+	unlink(addr.sun_path);
+
+	return 1;
+}
+
+
+/* Hand the command line over to the daemon, along with our standard input and outputs */
+int DaemonClient(const char *pszSocket, int argc, char* argv[])
+{
+	struct sockaddr_un addr;
+	struct msghdr msg;
+	struct cmsghdr *cmsg;
+	struct iovec iov;
+	int nSock, nArg, nRet;
+	int nFd[3] = { 0, 1, 2 };
+	char ctrl[CMSG_SPACE(3 * sizeof(int))];
+	char buf[1024];
+	char cTag = 'J';
+	unsigned char cEnd;
+
+	if (!SocketName(&addr, pszSocket, false))
+	{
+		return 1;
+	}
+
+	if (((nSock = socket(AF_UNIX, SOCK_STREAM, 0)) < 0) || (connect(nSock, (struct sockaddr*)&addr, sizeof(addr)) < 0))
+	{
+		printf("* Error: No jcp2 daemon on '%s'\n", addr.sun_path);
+		return 1;
+	}
+
+	// our terminal only goes to a daemon of ours
+	if (!PeerIsUs(nSock))
+	{
+		printf("* Error: The socket '%s' is not one of your jcp2 daemons\n", addr.sun_path);
+		close(nSock);
+		return 1;
+	}
+
+	memset(&msg, 0, sizeof(msg));
+	memset(ctrl, 0, sizeof(ctrl));
+	iov.iov_base = &cTag;
+	iov.iov_len = 1;
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = ctrl;
+	msg.msg_controllen = sizeof(ctrl);
+	cmsg = CMSG_FIRSTHDR(&msg);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN(3 * sizeof(int));
+	memcpy(CMSG_DATA(cmsg), nFd, 3 * sizeof(int));
+
+	fflush(stdout);
+
+	if (sendmsg(nSock, &msg, 0) != 1)
+	{
+		printf("* Error: Can't talk to the jcp2 daemon\n");
+		close(nSock);
+		return 1;
+	}
+
+	// working directory, for the relative paths
+	if (NULL == getcwd(buf, sizeof(buf)))
+	{
+		strcpy(buf, "/");
+	}
+	SendAll(nSock, buf, (int)strlen(buf) + 1);
+
+	// the arguments, but the one sending us here
+	for (nArg = 1; nArg < argc; nArg++)
+	{
+		if (strncmp(argv[nArg], "--remote", 8) && argv[nArg][0])
+		{
+			SendAll(nSock, argv[nArg], (int)strlen(argv[nArg]) + 1);
+		}
+	}
+	SendAll(nSock, "", 1);
+
+	// the job runs on our terminal, just wait for its exit code
+	while ((nRet = (int)read(nSock, &cEnd, 1)) != 1)
+	{
+		if ((nRet < 0) && (EINTR == errno))
+		{
+			continue;
+		}
+
+		printf("\n* Error: Lost the jcp2 daemon\n");
+		cEnd = 1;
+		break;
+	}
+
+	close(nSock);
+	return cEnd;
+}
+
+#endif
@@ -0,0 +1,17 @@
+#ifndef __JCP_DAEMON_H
+#define __JCP_DAEMON_H
+
+/* Daemon mode: a long lived jcp2 keeps the EZ-HOST open with turbow installed,
+   and the thin clients (--remote) hand their command line over a Unix socket.
+
+   Request: a byte carrying the client standard input and outputs (SCM_RIGHTS),
+   then the client working directory and the arguments, each one terminated
+   by a 0 byte, and an empty string to close the list.
+   Answer: the job exit code byte, once done. */
+
+typedef int (*DAEMONJOB)(int argc, char* argv[]);
+
+int DaemonServe(const char *pszSocket, DAEMONJOB pfnJob);		/* returns on failure only */
+int DaemonClient(const char *pszSocket, int argc, char* argv[]);	/* returns the job exit code */
+
+#endif
@@ -0,0 +1,52 @@
+/* jcp_delta.c : delta flashing plan
+
+	The flash stub erases a number of 64k blocks from the start of the
+	bank, so a delta flash erases up to the last block which differs from
+	the image, and programs the image up to there only. The blocks after
+	it are known to hold the same data already.
+
+	What the bank holds is read from the board, not remembered: the
+	checksum stub of --verify sums the bank per 64k block, and DoVerify
+	flags the blocks whose sums differ from the image ones. A record on
+	the PC could not know about a bank flashed by another PC, another
+	tool or the BIOS menu.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "jcp2.h"
+#include "jcp_delta.h"
+
+
+/* Blocks to erase for the image to match, from the blocks flagged as differing */
+int DeltaPlan(const uchar *pDiffers, int base, int nLen)
+{
+	int nBlock, nErase;
+
+	if ((nLen <= 0) || (base < FLASH_BASE) || (base + nLen > FLASH_BASE + FLASH_BANKSIZE))
+	{
+		return -1;
+	}
+
+	// erase up to the last block which differs
+	for (nErase = 0, nBlock = 0; nBlock < DELTA_MAXBLOCKS; nBlock++)
+	{
+		if (pDiffers[nBlock])
+		{
+			nErase = nBlock + 1;
+		}
+	}
+
+	if (nErase > FLASH_MAXBLOCKS)
+	{
+		return -1;
+	}
+
+	if (g_OptVerbose)
+	{
+		printf("Delta: %d blocks to erase, the image covers %d\n", nErase, (int)((base + nLen - 1 - FLASH_BASE) / FLASH_BLOCKSIZE) + 1);
+	}
+
+	return nErase;
+}
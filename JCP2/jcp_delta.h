@@ -0,0 +1,13 @@
+#ifndef __JCP_DELTA_H
+#define __JCP_DELTA_H
+
+/* Delta flashing: the bank is read back as a checksum per 64k block by
+   the checksum stub (DoVerify), the blocks which differ from the image
+   are flagged, and only the bank up to the last of them is erased and
+   programmed again. */
+
+#define DELTA_MAXBLOCKS	(FLASH_BANKSIZE / FLASH_BLOCKSIZE)
+
+int DeltaPlan(const uchar *pDiffers, int base, int nLen);		/* blocks to erase, 0 if nothing changed, -1 if it can't be done */
+
+#endif
@@ -0,0 +1,60 @@
+/* jcp_erase.c : erase planning
+
+	The flash stub erases a number of 64k blocks from the start of the
+	bank, at about 300ms each. DoFlash used to ask for 32 blocks (2MB)
+	for any image up to 2MB, and 62 above, so a 300KB cart waited ten
+	seconds for blocks it never wrote. The blocks are now counted up to
+	the last one a segment of the image covers.
+
+	As WriteABlock writes them, a bank keeps its cart header space
+	($800000-$801FFF), but in the second half of a 6MB image, which goes
+	to bank 2 from $800000. The first half of a 6MB image stops at
+	$C00000, the rest is the second half.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "jcp2.h"
+#include "jcp_erase.h"
+
+
+/* Blocks to erase for the image to be flashed to a bank (0 or 1), bSixMeg for a 6MB half */
+int ErasePlan(const IMAGEINFO *pImage, int nBank, bool bSixMeg)
+{
+	int nFirst = ((bSixMeg) && (1 == nBank)) ? FLASH_BASE : FLASH_BASE + 0x2000;	/* first address written */
+	int nSeg, nStart, nEnd, nBlocks;
+
+	for (nBlocks = 1, nSeg = 0; nSeg < pImage->nSegs; nSeg++)
+	{
+		nStart = pImage->segs[nSeg].base;
+		nEnd = nStart + pImage->segs[nSeg].nLen + pImage->segs[nSeg].nZero;
+
+		if (nStart < nFirst)
+		{
+			nStart = nFirst;
+		}
+		if (nEnd > FLASH_BASE + FLASH_BANKSIZE)
+		{
+			nEnd = FLASH_BASE + FLASH_BANKSIZE;
+		}
+
+		// up to the block with the last byte
+		if ((nEnd > nStart) && ((nEnd - 1 - FLASH_BASE) / FLASH_BLOCKSIZE + 1 > nBlocks))
+		{
+			nBlocks = (nEnd - 1 - FLASH_BASE) / FLASH_BLOCKSIZE + 1;
+		}
+	}
+
+	if (nBlocks > FLASH_MAXBLOCKS)
+	{
+		nBlocks = FLASH_MAXBLOCKS;
+	}
+
+	if (g_OptVerbose)
+	{
+		printf("Erase plan: %d blocks of %sbank %d, $%06X-$%06X\n", nBlocks, bSixMeg ? "6MB, " : "", nBank + 1, FLASH_BASE, FLASH_BASE + nBlocks * FLASH_BLOCKSIZE - 1);
+	}
+
+	return nBlocks;
+}
@@ -0,0 +1,11 @@
+#ifndef __JCP_ERASE_H
+#define __JCP_ERASE_H
+
+/* Erase planning: the number of 64k blocks the flash stub has to erase,
+   from the start of the bank, for the image segments to land on erased
+   flash. It is worked out from the flash layout being written, a bank,
+   or one half of a 6MB image. */
+
+int ErasePlan(const IMAGEINFO *pImage, int nBank, bool bSixMeg);	/* blocks to erase, 1 to FLASH_MAXBLOCKS */
+
+#endif
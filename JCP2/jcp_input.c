@@ -0,0 +1,269 @@
+/* jcp_input.c : input file access
+
+	A regular file is mapped read-only, and only the pages actually sent
+	are ever touched, so a small upload costs a small upload whatever the
+	largest image jcp2 accepts. Anything which can't be mapped, a pipe or
+	the standard input ("-"), is read as the data arrives: the beginning
+	first, for the format detection, then as the upload asks for it.
+	Its buffer is allocated at the largest size, so the data never moves,
+	but only the pages written to are ever committed.
+
+	The input is never written to, the byte swap for the upload is made
+	in its own buffer.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#if defined(WIN32) || defined(WIN64)
+#include <windows.h>
+#include <io.h>
+#include <fcntl.h>
+#else
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#endif
+#include "jcp2.h"
+#include "jcp_input.h"
+
+#define INPUT_NONE		0
+#define INPUT_MAPPED	1
+#define INPUT_READ		2
+
+static int s_nKind = INPUT_NONE;
+static uchar *s_pData = NULL;
+static int s_nLen = 0;
+static int s_nMax = 0;
+static FILE *s_pStream = NULL;		/* the input still arriving, NULL once it is all there */
+#if defined(WIN32) || defined(WIN64)
+static HANDLE s_hMapping = NULL;
+#endif
+
+
+/* Map the file, up to nMax bytes */
+static bool InputMap(const char *pszName, int nMax)
+{
+#if defined(WIN32) || defined(WIN64)
+	HANDLE hFile;
+	DWORD nHigh, nSize;
+
+	hFile = CreateFileA(pszName, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (INVALID_HANDLE_VALUE == hFile)
+	{
+		return false;
+	}
+
+	if ((FILE_TYPE_DISK != GetFileType(hFile)) || (INVALID_FILE_SIZE == (nSize = GetFileSize(hFile, &nHigh))) || !nSize)
+	{
+		CloseHandle(hFile);
+		return false;
+	}
+
+	if (nHigh || (nSize > (DWORD)nMax))
+	{
+		nSize = nMax;
+	}
+
+	// the mapping keeps the file open
+	s_hMapping = CreateFileMappingA(hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+	CloseHandle(hFile);
+
+	if (NULL == s_hMapping)
+	{
+		return false;
+	}
+
+	if (NULL == (s_pData = (uchar*)MapViewOfFile(s_hMapping, FILE_MAP_READ, 0, 0, nSize)))
+	{
+		CloseHandle(s_hMapping);
+		s_hMapping = NULL;
+		return false;
+	}
+#else
+	struct stat st;
+	void *pMap;
+	int nFile;
+	int nSize;
+
+	if ((nFile = open(pszName, O_RDONLY)) < 0)
+	{
+		return false;
+	}
+
+	if (fstat(nFile, &st) || !S_ISREG(st.st_mode) || (st.st_size <= 0))
+	{
+		close(nFile);
+		return false;
+	}
+
+	nSize = (st.st_size > nMax) ? nMax : (int)st.st_size;
+
+	// the mapping keeps the file open
+	pMap = mmap(NULL, nSize, PROT_READ, MAP_PRIVATE, nFile, 0);
+	close(nFile);
+
+	if (MAP_FAILED == pMap)
+	{
+		return false;
+	}
+
+	// the upload reads it once, from the start
+	madvise(pMap, nSize, MADV_SEQUENTIAL);
+	s_pData = (uchar*)pMap;
+#endif
+
+	s_nLen = nSize;
+	s_nMax = nSize;
+	s_nKind = INPUT_MAPPED;
+	return true;
+}
+
+
+/* No more data is expected */
+static void InputEnd(void)
+{
+	if ((NULL != s_pStream) && (stdin != s_pStream))
+	{
+		fclose(s_pStream);
+	}
+
+	s_pStream = NULL;
+}
+
+
+/* Get ready to read the file, or the standard input, as the data comes */
+static bool InputRead(const char *pszName, int nMax)
+{
+	if (strcmp(pszName, "-"))
+	{
+		s_pStream = fopen(pszName, "rb");
+	}
+	else
+	{
+#if defined(WIN32) || defined(WIN64)
+		_setmode(_fileno(stdin), _O_BINARY);
+#endif
+		s_pStream = stdin;
+	}
+
+	if (NULL == s_pStream)
+	{
+		return false;
+	}
+
+	if (NULL == (s_pData = (uchar*)malloc(nMax)))
+	{
+		InputEnd();
+		return false;
+	}
+
+	s_nLen = 0;
+	s_nMax = nMax;
+	s_nKind = INPUT_READ;
+	return true;
+}
+
+
+/* Open an input file, at most nMax bytes of it, and make sure nHead of them are there */
+uchar *InputOpen(const char *pszName, int nMax, int nHead, int *pLen)
+{
+	InputClose();
+
+	if ((!strcmp(pszName, "-") || !InputMap(pszName, nMax)) && !InputRead(pszName, nMax))
+	{
+		*pLen = 0;
+		return NULL;
+	}
+
+	if (InputMore(nHead) < 1)
+	{
+		InputClose();
+		*pLen = 0;
+		return NULL;
+	}
+
+	*pLen = s_nLen;
+	return s_pData;
+}
+
+
+/* Wait for the input to hold nWant bytes, or to end */
+/* returns the number of bytes there */
+int InputMore(int nWant)
+{
+	int nRead;
+
+	if (nWant > s_nMax)
+	{
+		nWant = s_nMax;
+	}
+
+	while ((NULL != s_pStream) && (s_nLen < nWant))
+	{
+		if ((nRead = (int)fread(s_pData + s_nLen, 1, nWant - s_nLen, s_pStream)) < 1)
+		{
+			InputEnd();
+			break;
+		}
+		s_nLen += nRead;
+	}
+
+	// the rest would not be used anyway
+	if (s_nLen >= s_nMax)
+	{
+		InputEnd();
+	}
+
+	return s_nLen;
+}
+
+
+/* true once the whole input is there */
+bool InputComplete(void)
+{
+	return (NULL == s_pStream);
+}
+
+
+/* Release the input */
+void InputClose(void)
+{
+	if (INPUT_MAPPED == s_nKind)
+	{
+#if defined(WIN32) || defined(WIN64)
+		UnmapViewOfFile(s_pData);
+		CloseHandle(s_hMapping);
+		s_hMapping = NULL;
+#else
+		munmap(s_pData, s_nLen);
+#endif
+	}
+	else if (INPUT_READ == s_nKind)
+	{
+		InputEnd();
+		free(s_pData);
+	}
+
+	s_nKind = INPUT_NONE;
+	s_pData = NULL;
+	s_nLen = 0;
+	s_nMax = 0;
+}
+
+
+/* How the input is held, for the verbose mode */
+const char *InputKind(void)
+{
+	switch (s_nKind)
+	{
+		case INPUT_MAPPED:
+			return "mapped";
+		case INPUT_READ:
+			return "read";
+		default:
+			return "none";
+	}
+}
@@ -0,0 +1,15 @@
+#ifndef __JCP_INPUT_H
+#define __JCP_INPUT_H
+
+/* Input file: mapped read-only when possible, so the upload views are
+   taken from the mapping directly, read as the data arrives otherwise
+   (pipes, devices, the standard input as "-").
+   One input at a time, its data stays where it is until InputClose. */
+
+uchar *InputOpen(const char *pszName, int nMax, int nHead, int *pLen);	/* NULL if the file can't be read, or is empty */
+int InputMore(int nWant);		/* waits for nWant bytes in all, or the end of the input */
+bool InputComplete(void);
+void InputClose(void);
+const char *InputKind(void);
+
+#endif
@@ -0,0 +1,147 @@
+/* jcp_mbox.c : the console mailbox
+
+	Every console message is a whole buffer: the PC reads the 4080 bytes
+	of it, even for a skunkNOP or a flag, then frees it. A small message
+	goes through the mailbox instead, in the free EZ-HOST RAM at $3800:
+	the PC reads its control word along with the buffer length words, and
+	the message with one more read of up to 16 bytes.
+
+	The Jag writes the data first, then the control word. Like a buffer
+	length word, the high byte of it may be seen set before the low one,
+	so a message longer than 16 bytes is not there yet. A ping is sent
+	back in the PC slot, that the Jag frees once it has read it, or once
+	a new ping is sent: a ping waits until the PC slot is free.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "jcp2.h"
+#include "jcp_transport.h"
+#include "jcp_swap.h"
+#include "jcp_mbox.h"
+
+
+/* Write a word at an EZ address, until it gets there */
+static void MboxPoke(int ez, unsigned short nWord)
+{
+	for (;;)
+	{
+		if (EZWrite(ez, &nWord, 2) == 2)
+		{
+			break;
+		}
+
+		Reattach();
+	}
+}
+
+
+/* Both slots free, nothing sent before the console started is kept */
+void MboxReset(void)
+{
+	MboxPoke(MBOX_JAG + MBOX_CTRL, 0xffff);
+	MboxPoke(MBOX_PC + MBOX_CTRL, 0xffff);
+}
+
+
+/* Handle the message waiting in the Jag slot, if any */
+/* returns true if there was one */
+bool MboxService(void)
+{
+	unsigned short nCtrl = 0xffff;
+	uchar data[MBOX_MAXLEN];
+	int nType, nLen, idx;
+
+	if (EZRead(MBOX_JAG + MBOX_CTRL, &nCtrl, 2) != 2)
+	{
+		Reattach();
+		return false;
+	}
+
+	nType = nCtrl >> 8;
+	nLen = nCtrl & 0xff;
+
+	if ((0xff == nType) || (nLen > MBOX_MAXLEN))
+	{
+		return false;
+	}
+
+	// the answer to a ping is not written over one the Jag did not read
+	if (MBOX_PING == nType)
+	{
+		if (EZRead(MBOX_PC + MBOX_CTRL, &nCtrl, 2) != 2)
+		{
+			Reattach();
+			return false;
+		}
+
+		if (0xffff != nCtrl)
+		{
+			return false;
+		}
+	}
+
+	memset(data, 0, sizeof(data));
+
+	if (nLen > 0)
+	{
+		for (;;)
+		{
+			if (EZRead(MBOX_JAG, data, (nLen + 1) & ~1) == ((nLen + 1) & ~1))
+			{
+				break;
+			}
+
+			Reattach();
+		}
+	}
+
+	// the slot is free again for the next message, the data is here
+	MboxPoke(MBOX_JAG + MBOX_CTRL, 0xffff);
+
+	switch (nType)
+	{
+		case MBOX_PING:
+			// same bytes back, still swapped
+			if (nLen > 0)
+			{
+				for (;;)
+				{
+					if (EZWrite(MBOX_PC, data, (nLen + 1) & ~1) == ((nLen + 1) & ~1))
+					{
+						break;
+					}
+
+					Reattach();
+				}
+			}
+			MboxPoke(MBOX_PC + MBOX_CTRL, (unsigned short)((MBOX_PING << 8) | nLen));
+
+			if (g_OptVerbose)
+			{
+				printf("Mailbox ping, %d bytes\n", nLen);
+			}
+			break;
+
+		case MBOX_POST:
+			SwapBytes(data, data, (nLen + 1) & ~1);
+			printf("[mbox]");
+			for (idx = 0; idx + 1 < nLen; idx += 2)
+			{
+				printf(" %02X%02X", data[idx], data[idx + 1]);
+			}
+			if (idx < nLen)
+			{
+				printf(" %02X", data[idx]);
+			}
+			printf("\n");
+			break;
+
+		default:
+			printf("Warning: Unimplemented mailbox message 0x%02X\n", nType);
+			break;
+	}
+
+	return true;
+}
@@ -0,0 +1,21 @@
+#ifndef __JCP_MBOX_H
+#define __JCP_MBOX_H
+
+/* Console mailbox: short messages between the Jaguar and the PC, in the
+   free EZ-HOST RAM at $3800, next to the console buffers. Each way has a
+   slot of 16 bytes of data and a control word, the message type in the
+   high byte and its length in the low one, 0xffff when the slot is free.
+   The skunk library side is skunkMBOXPOST and skunkMBOXPING (skunk.s). */
+
+#define MBOX_JAG		0x3800		/* Jag to PC slot */
+#define MBOX_PC			0x3820		/* PC to Jag slot, the answers */
+#define MBOX_CTRL		0x10		/* control word, after the data */
+#define MBOX_MAXLEN		16
+
+#define MBOX_PING		1			/* sent back as is */
+#define MBOX_POST		2			/* printed, no answer */
+
+void MboxReset(void);				/* both slots free, when the console starts */
+bool MboxService(void);				/* true if a message was handled */
+
+#endif
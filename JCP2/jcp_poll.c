@@ -0,0 +1,156 @@
+/* jcp_poll.c : buffer word polling, with an adaptive backoff
+
+	Every wait on the Jaguar is a loop reading a buffer length word. They
+	used to sleep 100ms or 500ms between two reads, or not at all, so the
+	end of an erase or a boot was seen late, and a console spent its time
+	burning a core. The backoff here polls without sleeping for the first
+	2ms, which is when the answers usually come, then sleeps 100us and
+	doubles the sleep each time up to 20ms: a console idle for hours reads
+	the words 50 times a second, and answers a request within 20ms.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#if defined(WIN32) || defined(WIN64)
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+#include "jcp2.h"
+#include "jcp_transport.h"
+#include "jcp_poll.h"
+
+#define POLL_TIGHTUS		2000		/* no sleep for that long */
+#define POLL_FIRSTSLEEPUS	100
+#define POLL_MAXSLEEPUS		20000
+#define POLL_SPINUS			100000		/* spinner refresh */
+
+
+/* Sleep for some microseconds, as close as the system goes */
+static void PollSleep(unsigned int nUs)
+{
+#if defined(WIN32) || defined(WIN64)
+	// millisecond granularity, 0 gives the time slice away
+	Sleep(nUs / 1000);
+#else
+	usleep(nUs);
+#endif
+}
+
+
+/* Start a wait, nHintMs is the expected delay, 0 if it is not known */
+void PollStart(POLLER *pPoll, int nHintMs, bool bSpin)
+{
+	pPoll->tStart = GetMicroCount();
+	pPoll->tSpin = pPoll->tStart;
+	pPoll->bSpin = bSpin;
+	pPoll->nSleepUs = POLL_FIRSTSLEEPUS;
+
+	// sleep through most of the expected delay, estimates are on the safe side
+	pPoll->tTight = pPoll->tStart + ((nHintMs > 0) ? ((unsigned long long)nHintMs * 750) : 0);
+}
+
+
+/* Something happened, poll tight again */
+void PollBusy(POLLER *pPoll)
+{
+	pPoll->tTight = GetMicroCount();
+	pPoll->nSleepUs = POLL_FIRSTSLEEPUS;
+}
+
+
+/* Nothing new yet, wait before polling again */
+void PollIdle(POLLER *pPoll)
+{
+	unsigned long long tNow = GetMicroCount();
+
+	if ((pPoll->bSpin) && (tNow - pPoll->tSpin >= POLL_SPINUS))
+	{
+		Spin();
+		pPoll->tSpin = tNow;
+	}
+
+	if (tNow < pPoll->tTight)
+	{
+		// within the hint, in steps short enough to keep the spinner going
+		PollSleep((pPoll->tTight - tNow > POLL_SPINUS) ? POLL_SPINUS : (unsigned int)(pPoll->tTight - tNow));
+	}
+	else
+	{
+		if (tNow - pPoll->tTight >= POLL_TIGHTUS)
+		{
+			PollSleep(pPoll->nSleepUs);
+
+			if ((pPoll->nSleepUs *= 2) > POLL_MAXSLEEPUS)
+			{
+				pPoll->nSleepUs = POLL_MAXSLEEPUS;
+			}
+		}
+	}
+}
+
+
+/* Wait for a buffer word to meet a condition, or nTimeoutMs if not 0 */
+/* returns false on timeout, the last word read is in pWord */
+bool PollWord(int ez, POLLDONE pfnDone, int nHintMs, int nTimeoutMs, bool bSpin, unsigned short *pWord)
+{
+	POLLER poll;
+	unsigned short nWord = 0;
+	bool bRet = true;
+
+	PollStart(&poll, nHintMs, bSpin);
+
+	if (bSpin)
+	{
+		Spin();
+	}
+
+	for (;;)
+	{
+		if (EZRead(ez, &nWord, 2) != 2)
+		{
+			Reattach();
+		}
+		else if (pfnDone(nWord))
+		{
+			break;
+		}
+
+		if ((nTimeoutMs > 0) && (GetMicroCount() - poll.tStart > (unsigned long long)nTimeoutMs * 1000))
+		{
+			bRet = false;
+			break;
+		}
+
+		PollIdle(&poll);
+	}
+
+	if (NULL != pWord)
+	{
+		*pWord = nWord;
+	}
+
+	return bRet;
+}
+
+
+bool PollIsFree(unsigned short nWord)
+{
+	return (0xffff == nWord);
+}
+
+
+bool PollIsZero(unsigned short nWord)
+{
+	return (0 == nWord);
+}
+
+
+// a value over 0xf0xx is reserved for future use, and we can't count on
+// the lower bytes to be correct since the high byte can change first in
+// rare race conditions.
+bool PollIsReady(unsigned short nWord)
+{
+	return (0xf0ff == (nWord & 0xf0ff));
+}
@@ -0,0 +1,31 @@
+#ifndef __JCP_POLL_H
+#define __JCP_POLL_H
+
+/* Polling of the EZ-HOST buffer words, with an adaptive backoff: tight
+   polls while the Jaguar answers quickly, then longer and longer sleeps
+   as nothing happens, up to 20ms. A hint, the expected wait in ms, lets
+   a known delay (the flash erase) go by asleep, and the polls be tight
+   again when it should end. */
+
+typedef bool (*POLLDONE)(unsigned short nWord);
+
+typedef struct
+{
+	unsigned long long tStart;			/* microseconds */
+	unsigned long long tTight;			/* the tight polls start (again) there */
+	unsigned long long tSpin;
+	unsigned int nSleepUs;
+	bool bSpin;
+} POLLER;
+
+void PollStart(POLLER *pPoll, int nHintMs, bool bSpin);
+void PollIdle(POLLER *pPoll);			/* nothing new, wait a bit before polling again */
+void PollBusy(POLLER *pPoll);			/* something happened, back to the tight polls */
+bool PollWord(int ez, POLLDONE pfnDone, int nHintMs, int nTimeoutMs, bool bSpin, unsigned short *pWord);	/* false on timeout */
+
+/* the usual conditions on a buffer length word */
+bool PollIsFree(unsigned short nWord);		/* 0xffff, the buffer is free */
+bool PollIsZero(unsigned short nWord);		/* 0, the block was taken, or the buffer is locked */
+bool PollIsReady(unsigned short nWord);		/* free, the high nibbles may tell more (0xf0ff) */
+
+#endif
@@ -0,0 +1,257 @@
+/* jcp_prep.c : upload preparation, on a worker thread
+
+	The upload of an image used to start with its preparation, once the
+	Jaguar was ready: the runs of blocks worked out, and the blocks of 0xFF
+	looked for as they were sent. The Jaguar gets ready for a flash upload
+	in seconds (turbow, flash stub, erase), so the transfer functions start
+	the preparation first, on a worker thread, and SendFile only waits for
+	it, if it ever has to.
+
+	The image is not copied: a block is read straight from the input (the
+	file mapping, see jcp_input.c) and swapped into the transport block by
+	WriteABlock, only a block across segments is put together on the side.
+	Looking for the blocks of 0xFF reads the whole image once, which brings
+	the pages of the mapping in while the Jag gets ready.
+
+	The worker thread never talks to the Skunkboard, and only reads the
+	image data: the input file, or a builtin stub.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#if defined(WIN32) || defined(WIN64)
+#include <windows.h>
+#include <process.h>
+#else
+#include <pthread.h>
+#endif
+#include "jcp2.h"
+#include "jcp_prep.h"
+
+static PREPIMAGE s_Back;			/* prepared by the worker thread */
+static PREPIMAGE s_Front;			/* prepared on the spot */
+static bool s_bBackValid = false;		/* set by the worker thread, if it could do it */
+static bool s_bBackPending = false;		/* started, and neither taken nor discarded */
+static bool s_bBackRunning = false;		/* the thread is still to be joined */
+#if defined(WIN32) || defined(WIN64)
+static HANDLE s_hThread = NULL;
+#else
+static pthread_t s_Thread;
+#endif
+
+
+/* Same segments, the same data to send */
+static bool SameImage(const IMAGEINFO *pA, const IMAGEINFO *pB)
+{
+	int nSeg;
+
+	if (pA->nSegs != pB->nSegs)
+	{
+		return false;
+	}
+
+	for (nSeg = 0; nSeg < pA->nSegs; nSeg++)
+	{
+		if ((pA->segs[nSeg].base != pB->segs[nSeg].base) || (pA->segs[nSeg].pData != pB->segs[nSeg].pData) ||
+			(pA->segs[nSeg].nLen != pB->segs[nSeg].nLen) || (pA->segs[nSeg].nZero != pB->segs[nSeg].nZero))
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+/* Make the runs of an image, and spot their blocks of 0xFF */
+/* returns false if it is out of memory */
+static bool PrepImage(PREPIMAGE *pPrep, const IMAGEINFO *pImage)
+{
+	const IMAGESEG *pSegs = pImage->segs;
+	IMAGESEG *pRuns = pPrep->runs;
+	uchar block[4064];
+	int nSeg, nRun, nPos, nBlocks, len;
+	uchar *pNew;
+	const uchar *fptr;
+
+	pPrep->image = *pImage;
+	pPrep->nRuns = 0;
+
+	// group the segments into runs, a gap shorter than a block costs nothing to send as zeros
+	for (nBlocks = 0, nSeg = 0; nSeg < pImage->nSegs; nSeg++)
+	{
+		nRun = pPrep->nRuns;
+
+		if ((nRun > 0) && (pSegs[nSeg].base >= pRuns[nRun - 1].base + pRuns[nRun - 1].nLen) && (pSegs[nSeg].base - (pRuns[nRun - 1].base + pRuns[nRun - 1].nLen) < 4064))
+		{
+			pRuns[nRun - 1].nLen = pSegs[nSeg].base - pRuns[nRun - 1].base;
+		}
+		else
+		{
+			pRuns[nRun].base = pSegs[nSeg].base;
+			pRuns[nRun].pData = NULL;
+			pRuns[nRun].nLen = 0;
+			pRuns[nRun].nZero = 0;
+			pPrep->nRuns = ++nRun;
+		}
+
+		pRuns[nRun - 1].nLen += pSegs[nSeg].nLen + pSegs[nSeg].nZero;
+		nBlocks += (pSegs[nSeg].nLen + pSegs[nSeg].nZero) / 4064 + 2;
+	}
+
+	if (pPrep->nBlankLen < nBlocks)
+	{
+		if (NULL == (pNew = (uchar*)realloc(pPrep->pBlank, nBlocks)))
+		{
+			return false;
+		}
+		pPrep->pBlank = pNew;
+		pPrep->nBlankLen = nBlocks;
+	}
+
+	// reading the blocks also brings the pages of a mapped file in, ahead of the upload
+	for (nBlocks = 0, nRun = 0; nRun < pPrep->nRuns; nRun++)
+	{
+		for (nPos = 0; nPos < pRuns[nRun].nLen; nPos += 4064)
+		{
+			len = (pRuns[nRun].nLen - nPos < 4064) ? (pRuns[nRun].nLen - nPos) : 4064;
+			fptr = PrepBlock(pPrep, pRuns[nRun].base + nPos, len, block);
+			pPrep->pBlank[nBlocks++] = (0xFF == fptr[0]) && !memcmp(fptr, fptr + 1, len - 1);
+		}
+	}
+
+	return true;
+}
+
+
+/* The data of a block of the runs: straight from its segment when it lies */
+/* within its data, or put together in pBlock (4064 bytes) with the zeros around */
+const uchar *PrepBlock(const PREPIMAGE *pPrep, int base, int len, uchar *pBlock)
+{
+	const IMAGESEG *pSegs = pPrep->image.segs;
+	int nSeg, nFrom, nTo;
+
+	for (nSeg = 0; nSeg < pPrep->image.nSegs; nSeg++)
+	{
+		if ((base >= pSegs[nSeg].base) && (base + len <= pSegs[nSeg].base + pSegs[nSeg].nLen))
+		{
+			return pSegs[nSeg].pData + (base - pSegs[nSeg].base);
+		}
+	}
+
+	// across segments, a gap or zeros
+	memset(pBlock, 0, len);
+	for (nSeg = 0; nSeg < pPrep->image.nSegs; nSeg++)
+	{
+		nFrom = (pSegs[nSeg].base > base) ? pSegs[nSeg].base : base;
+		nTo = (pSegs[nSeg].base + pSegs[nSeg].nLen < base + len) ? pSegs[nSeg].base + pSegs[nSeg].nLen : base + len;
+
+		if (nFrom < nTo)
+		{
+			memcpy(pBlock + (nFrom - base), pSegs[nSeg].pData + (nFrom - pSegs[nSeg].base), nTo - nFrom);
+		}
+	}
+
+	return pBlock;
+}
+
+
+#if defined(WIN32) || defined(WIN64)
+static unsigned __stdcall PrepThread(void *pArg)
+{
+	s_bBackValid = PrepImage(&s_Back, &s_Back.image);
+	return 0;
+}
+#else
+static void *PrepThread(void *pArg)
+{
+	s_bBackValid = PrepImage(&s_Back, &s_Back.image);
+	return NULL;
+}
+#endif
+
+
+/* Wait for the worker thread, if it runs */
+static void PrepJoin(void)
+{
+	if (s_bBackRunning)
+	{
+#if defined(WIN32) || defined(WIN64)
+		WaitForSingleObject(s_hThread, INFINITE);
+		CloseHandle(s_hThread);
+		s_hThread = NULL;
+#else
+		pthread_join(s_Thread, NULL);
+#endif
+		s_bBackRunning = false;
+	}
+}
+
+
+/* Start preparing an image on the worker thread */
+/* the image data must stay until it is taken, or discarded */
+void PrepStart(const IMAGEINFO *pImage)
+{
+	PrepDiscard();
+
+	s_Back.image = *pImage;
+	s_bBackPending = true;
+
+#if defined(WIN32) || defined(WIN64)
+	s_hThread = (HANDLE)_beginthreadex(NULL, 0, PrepThread, NULL, 0, NULL);
+	s_bBackRunning = (NULL != s_hThread);
+#else
+	s_bBackRunning = !pthread_create(&s_Thread, NULL, PrepThread, NULL);
+#endif
+
+	// no thread, SendFile will do it
+	if (!s_bBackRunning)
+	{
+		s_bBackPending = false;
+
+		if (g_OptVerbose)
+		{
+			printf("Can't start the upload preparation thread\n");
+		}
+	}
+}
+
+
+/* The prepared image, from the worker thread if it is the one started */
+/* valid until the next call */
+const PREPIMAGE *PrepTake(const IMAGEINFO *pImage)
+{
+	if (s_bBackPending && SameImage(&s_Back.image, pImage))
+	{
+		PrepJoin();
+		s_bBackPending = false;
+
+		if (s_bBackValid)
+		{
+			s_bBackValid = false;
+			return &s_Back;
+		}
+	}
+
+	if (!PrepImage(&s_Front, pImage))
+	{
+		bye("Error: Not enough memory for the upload");
+	}
+
+	return &s_Front;
+}
+
+
+/* Forget the image started, before its data goes away, and what was prepared */
+void PrepDiscard(void)
+{
+	PrepJoin();
+	s_bBackPending = false;
+	s_bBackValid = false;
+
+	free(s_Back.pBlank);
+	free(s_Front.pBlank);
+	s_Back.pBlank = s_Front.pBlank = NULL;
+	s_Back.nBlankLen = s_Front.nBlankLen = 0;
+}
@@ -0,0 +1,24 @@
+#ifndef __JCP_PREP_H
+#define __JCP_PREP_H
+
+/* Upload preparation: the image segments grouped into runs of blocks,
+   and the blocks of 0xFF spotted, the data is left where it is.
+   PrepStart does it on a worker thread while the Skunkboard is opened
+   and the flash erased, PrepTake hands it to SendFile, or prepares the
+   image on the spot when it is not the one started. */
+
+typedef struct
+{
+	IMAGEINFO image;				/* the image prepared */
+	int nRuns;
+	IMAGESEG runs[MAX_SEGMENTS];	/* base and length only, the data is read with PrepBlock */
+	uchar *pBlank;					/* per block of the runs, true if all 0xFF */
+	int nBlankLen;
+} PREPIMAGE;
+
+void PrepStart(const IMAGEINFO *pImage);
+const PREPIMAGE *PrepTake(const IMAGEINFO *pImage);
+void PrepDiscard(void);
+const uchar *PrepBlock(const PREPIMAGE *pPrep, int base, int len, uchar *pBlock);
+
+#endif
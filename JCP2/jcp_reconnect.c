@@ -0,0 +1,102 @@
+/* jcp_reconnect.c : recovery from a failed transfer
+
+	Any failed access to the Skunkboard used to close the handle, sleep
+	1s, and look for a board on the whole bus again, turbow uploaded on
+	the way. Most failures are a transfer stalled or timed out on a busy
+	hub though, and the board is still there: Reattach retries on the
+	same handle first, a few times with a short backoff. Only a board
+	that left the bus (or does not answer anymore) is closed, and opened
+	again as soon as it is back: the one at the same bus and ports, with
+	the hotplug callbacks where libusb has them.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#if defined(WIN32) || defined(WIN64)
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+#include "jcp2.h"
+#include "jcp_transport.h"
+#include "jcp_poll.h"
+#include "jcp_reconnect.h"
+
+
+/* Time spent since tStart, added to the downtime, in ms */
+static int Downtime(unsigned long long tStart)
+{
+	int nMs = (int)((GetMicroCount() - tStart) / 1000);
+
+	g_EZStats.nDownMs += nMs;
+	return nMs;
+}
+
+
+/* Is the board still answering on the same handle */
+static bool RetryInPlace(void)
+{
+	unsigned short nWord;
+	int nTry;
+
+	for (nTry = 0; nTry < RECONNECT_RETRIES; nTry++)
+	{
+		if (EZLost())
+		{
+			return false;
+		}
+
+		Sleep((10 << nTry));
+
+		if (EZRead(0x1800 + 0xFEA, &nWord, 2) == 2)
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+
+/* called from a failed attempt to access the jag */
+void Reattach(void)
+{
+	unsigned long long tStart = GetMicroCount();
+	POLLER poll;
+	int nMs;
+
+	if (EZIsOpen() && RetryInPlace())
+	{
+		g_EZStats.nRetries++;
+		nMs = Downtime(tStart);
+
+		if (g_OptVerbose)
+		{
+			printf("Transfer failed, the board answers again after %d ms\n", nMs);
+		}
+		return;
+	}
+
+	printf("Waiting to handshake with 68k (control-c to abort)\n");
+	EZClose();
+
+	PollStart(&poll, 0, false);
+
+	// the same board, as soon as it is back
+	while (!EZReopen())
+	{
+		if (GetMicroCount() - tStart > (unsigned long long)RECONNECT_TIMEOUTMS * 1000)
+		{
+			bye("Error: Can't open EZ-HOST.\n");
+		}
+
+		EZWaitArrival(1000);
+		PollIdle(&poll);
+	}
+
+	g_EZStats.nReconnects++;
+	nMs = Downtime(tStart);
+
+	printf("Skunkboard back after %d ms\n", nMs);
+}
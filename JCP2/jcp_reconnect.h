@@ -0,0 +1,12 @@
+#ifndef __JCP_RECONNECT_H
+#define __JCP_RECONNECT_H
+
+/* Recovery from a failed transfer, Reattach (declared in jcp2.h): a
+   stalled transfer is retried on the same handle, a board that left the
+   bus is opened again, the same one, as soon as it is back. Both are
+   counted in g_EZStats, with the time they took. */
+
+#define RECONNECT_RETRIES		3			/* in place, before the board is taken as lost */
+#define RECONNECT_TIMEOUTMS		10000		/* to get the board back */
+
+#endif
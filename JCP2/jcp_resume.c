@@ -0,0 +1,116 @@
+/* jcp_resume.c : resumable uploads
+
+	A failed transfer used to call Reattach and go on with the next block,
+	the one that failed lost or not, and a handshake timeout aborted the
+	whole job: a 6MB flash over a long cable was done again from zero.
+
+	At most two blocks are not known to be on the Jag: the last one sent
+	to each buffer, since a buffer is only written once the Jag freed it.
+	A copy of them is kept, and after a failure the trailer in each buffer
+	tells if its block got there: the base, start and next buffer of the
+	block (the base moves on by 4064 for each block), whether the Jag took
+	it since (length back to -1) or not yet. The base alone repeats, the
+	console blocks all go to DUMMYBASE, so WriteABlock also numbers each
+	block in the spare trailer word at +FEC, which the 68K does not read,
+	and no two blocks in a row look alike. The blocks that are not there
+	are written again, in the order they were sent, the Jag follows the
+	next buffer chain and never sees a block twice.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "jcp2.h"
+#include "jcp_transport.h"
+#include "jcp_resume.h"
+
+typedef struct
+{
+	int ez;								/* 0 if the slot is empty */
+	uchar block[EZ_BLOCKSIZE];
+} KEPTBLOCK;
+
+static KEPTBLOCK s_Kept[2];				/* the oldest first */
+
+
+/* Keep a copy of a block about to be sent to the buffer at ez */
+void ResumeKeep(int ez, const uchar *block)
+{
+	// the block sent to that buffer before got there, it was freed since
+	if (s_Kept[1].ez != ez)
+	{
+		s_Kept[0] = s_Kept[1];
+	}
+
+	s_Kept[1].ez = ez;
+	memcpy(s_Kept[1].block, block, EZ_BLOCKSIZE);
+}
+
+
+/* A new upload, the blocks kept are there, or gone with a reset */
+void ResumeForget(void)
+{
+	s_Kept[0].ez = 0;
+	s_Kept[1].ez = 0;
+}
+
+
+/* Did the block get to its buffer, taken by the Jag since or not */
+static bool IsThere(const KEPTBLOCK *pKept)
+{
+	uchar trailer[14];
+
+	while (EZRead(pKept->ez + 0xFE0, trailer, 14) != 14)
+	{
+		Reattach();
+	}
+
+	// the Jag sets the length back to -1 once done, base, start, next and the serial number tell
+	return (!memcmp(trailer, pKept->block + 0xFE0, 10)) && (!memcmp(trailer + 12, pKept->block + 0xFEC, 2));
+}
+
+
+/* Recover from a failed transfer or handshake: reconnect, then send again */
+/* the blocks that did not make it. Returns false if none was kept */
+bool ResumeRecover(void)
+{
+	int nKept, nSent = 0;
+
+	if ((0 == s_Kept[0].ez) && (0 == s_Kept[1].ez))
+	{
+		return false;
+	}
+
+	// whatever is still queued either gets there or fails now
+	EZFlush();
+	Reattach();
+
+	for (nKept = 0; nKept < 2; nKept++)
+	{
+		if (0 == s_Kept[nKept].ez)
+		{
+			continue;
+		}
+
+		// a write that failed may still have got there
+		while (!IsThere(&s_Kept[nKept]))
+		{
+			if (EZWrite(s_Kept[nKept].ez, s_Kept[nKept].block, EZ_BLOCKSIZE) == EZ_BLOCKSIZE)
+			{
+				nSent++;
+				break;
+			}
+
+			Reattach();
+		}
+	}
+
+	g_EZStats.nResent += nSent;
+
+	if (nSent > 0)
+	{
+		printf("\nUpload resumed, %d block(s) sent again\n", nSent);
+	}
+
+	return true;
+}
@@ -0,0 +1,15 @@
+#ifndef __JCP_RESUME_H
+#define __JCP_RESUME_H
+
+/* Upload checkpoints: a copy of the blocks sent to each buffer and not
+   known to be on the Jag yet. After a failed transfer, or a handshake
+   that timed out, the upload goes on from where the Jag is: only the
+   blocks that did not make it to their buffer are sent again. */
+
+#define RESUME_TRIES		3			/* handshake timeouts in a row, before giving up */
+
+void ResumeForget(void);
+void ResumeKeep(int ez, const uchar *block);
+bool ResumeRecover(void);
+
+#endif
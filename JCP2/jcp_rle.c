@@ -0,0 +1,145 @@
+/* jcp_rle.c : compressed uploads
+
+	The USB link is what a RAM upload waits for, at about 4KB a round
+	trip, while the 68K has time to spare. Jaguar programs carry long runs
+	of zeros (BSS, padding, tables), so they go as a PackBits like stream
+	which the decompressor stub (rlestub.h) expands on the Jag side.
+
+	The stream: a control byte n from 0 to 127 is followed by n+1 bytes
+	to copy, one from -1 to -127 by a byte to repeat 1-n times, and -128
+	ends it. Runs of 3 bytes and more are repeated, anything shorter is
+	copied. The stub can't read ahead of its own writes, so the stub and
+	the stream go above the image, and the image is not expanded over them.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "jcp2.h"
+#include "jcp_rle.h"
+#include "rlestub.h"
+
+#define RLE_MAXRUN			128
+#define RLE_MINRUN			3		/* shorter runs cost more repeated than copied */
+#define RLE_END				0x80
+
+
+/* Length of the run of the same byte at pIn, up to RLE_MAXRUN */
+static int RunLength(const uchar *pIn, int nLen)
+{
+	int nRun;
+
+	if (nLen > RLE_MAXRUN)
+	{
+		nLen = RLE_MAXRUN;
+	}
+
+	for (nRun = 1; (nRun < nLen) && (pIn[nRun] == pIn[0]); nRun++)
+	{
+	}
+
+	return nRun;
+}
+
+
+/* Compress nLen bytes, pOut takes RLE_BOUND(nLen) */
+int RleCompress(const uchar *pIn, int nLen, uchar *pOut)
+{
+	int nPos = 0, nOut = 0;
+	int nRun, nCopy;
+
+	while (nPos < nLen)
+	{
+		nRun = RunLength(pIn + nPos, nLen - nPos);
+
+		if (nRun >= RLE_MINRUN)
+		{
+			pOut[nOut++] = (uchar)(1 - nRun);
+			pOut[nOut++] = pIn[nPos];
+			nPos += nRun;
+			continue;
+		}
+
+		// copy up to the next run worth repeating
+		for (nCopy = nRun; (nPos + nCopy < nLen) && (nCopy < RLE_MAXRUN); nCopy += nRun)
+		{
+			nRun = RunLength(pIn + nPos + nCopy, nLen - nPos - nCopy);
+			if (nRun >= RLE_MINRUN)
+			{
+				break;
+			}
+		}
+		if (nCopy > RLE_MAXRUN)
+		{
+			nCopy = RLE_MAXRUN;
+		}
+
+		pOut[nOut++] = (uchar)(nCopy - 1);
+		memcpy(pOut + nOut, pIn + nPos, nCopy);
+		nOut += nCopy;
+		nPos += nCopy;
+	}
+
+	pOut[nOut++] = RLE_END;
+
+	return nOut;
+}
+
+
+/* Build the stub and the stream of a RAM segment, the caller frees *ppBlob */
+/* returns its length, to send and start at *pBase, or 0 if it does not fit or is not smaller */
+int RleBuild(const IMAGESEG *pSeg, int entry, uchar **ppBlob, int *pBase)
+{
+	uchar *pImage, *pBlob;
+	int nLen = pSeg->nLen + pSeg->nZero;
+	int nBlob, nBase, nByte;
+
+	*ppBlob = NULL;
+
+	if ((nLen <= 0) || (pSeg->base < 0) || (pSeg->base + nLen > RLE_TOP))
+	{
+		return 0;
+	}
+
+	// the zeros after the data are expanded too
+	pImage = (uchar*)malloc(nLen);
+	pBlob = (uchar*)malloc(SIZE_OF_RLESTUB + RLE_BOUND(nLen) + 1);
+	if ((NULL == pImage) || (NULL == pBlob))
+	{
+		bye("Error: Out of memory for the compressed upload");
+	}
+	memcpy(pImage, pSeg->pData, pSeg->nLen);
+	memset(pImage + pSeg->nLen, 0, pSeg->nZero);
+
+	memcpy(pBlob, RLESTUB, SIZE_OF_RLESTUB);
+	for (nByte = 0; nByte < 4; nByte++)
+	{
+		pBlob[RLESTUB_DEST + nByte] = (uchar)(pSeg->base >> (24 - nByte * 8));
+		pBlob[RLESTUB_ENTRY + nByte] = (uchar)(entry >> (24 - nByte * 8));
+	}
+	nBlob = SIZE_OF_RLESTUB + RleCompress(pImage, nLen, pBlob + SIZE_OF_RLESTUB);
+	free(pImage);
+
+	// an even length, at the top of the free RAM
+	if (nBlob & 1)
+	{
+		pBlob[nBlob++] = 0;
+	}
+	nBase = (RLE_TOP - nBlob) & ~15;
+
+	if (g_OptVerbose)
+	{
+		printf("RLE: %d bytes as %d, stub at $%06X\n", nLen, nBlob, nBase);
+	}
+
+	if ((nBlob >= nLen) || (pSeg->base + nLen > nBase))
+	{
+		free(pBlob);
+		return 0;
+	}
+
+	*ppBlob = pBlob;
+	*pBase = nBase;
+
+	return nBlob;
+}
@@ -0,0 +1,15 @@
+#ifndef __JCP_RLE_H
+#define __JCP_RLE_H
+
+/* Compressed uploads (--rle): a RAM image goes as a run length stream,
+   behind the decompressor stub of rlestub.h, which expands it in place
+   and starts it. The stub and its stream are placed in the free RAM
+   above the image, below RLE_TOP. */
+
+#define RLE_TOP				0x1F0000	/* the top 64k of the RAM is left to the stack */
+#define RLE_BOUND(n)		((n) + (n) / 128 + 2)	/* longest stream for n bytes */
+
+int RleCompress(const uchar *pIn, int nLen, uchar *pOut);	/* stream length, end byte included */
+int RleBuild(const IMAGESEG *pSeg, int entry, uchar **ppBlob, int *pBase);	/* stub and stream to send at *pBase, 0 if not worth it */
+
+#endif
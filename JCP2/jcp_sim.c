@@ -0,0 +1,845 @@
+/* jcp_sim.c : simulated Skunkboard, for testing and benchmarking without a board
+
+	The EZ-HOST 16k OTG RAM is modeled byte for byte (little endian words,
+	like the real thing), and the Jaguar side of the protocol runs as a
+	small state machine, advanced each time the PC touches the board:
+
+	- BIOS reader: waits for a length at $xFEA, copies the block to its base,
+	  follows the $xFE8 next-block chain, and marks the buffer -1 once the
+	  copy is done, or 0 when the block starts a program.
+	- Flash stub: recognized by its 'move.l #blocks,d1 / move.l d1,$3FF0.w'
+	  header. Both buffers read 0 while the bank is erasing, then -1; the
+	  following blocks are programmed into the bank (bits can only clear).
+	  A -2 start returns to the BIOS reader, anything else boots the cart.
+	- Checksum stub (--verify): recognized by its HPI setup, sums the range
+	  of the bank given by its parameters and writes the table at $1800.
+	- Decompressor stub (--rle): recognized by its first instructions,
+	  expands the stream after it at once, and starts the program.
+	- BSS clearing stub: recognized the same way, clears the ranges of its
+	  list at once, and starts the program.
+	- Console producer: any other booted program behaves like HELLO.S:
+	  skunkRESET, one skunkCONSOLEWRITE, then skunkCONSOLECLOSE.
+	- Reset through the $304C scan codes restarts the BIOS after a delay.
+
+	USB costs g_SimXferUs per transfer plus a per byte rate, and the 68K
+	copy, flash and erase times are modeled too. With g_SimXferUs set to 0,
+	everything is instantaneous but the erase, which is handy for regression
+	runs.
+
+	A queued upload block stays in flight, like an asynchronous libusb
+	transfer: it lands on the next call to the board, and a failure is only
+	reported by the following queue or flush. With g_SimDropEvery set, every
+	so many queued blocks are lost on the way, to exercise that deferred
+	failure and the resumed upload (jcp_resume.c).
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#if defined(WIN32) || defined(WIN64)
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+#include "jcp2.h"
+#include "jcp_transport.h"
+#include "jcp_mbox.h"
+
+/* memory sizes */
+#define SIM_EZSIZE		0x4000
+#define SIM_RAMSIZE		(2*1024*1024)
+#define SIM_BANKSIZE	(4*1024*1024)
+#define SIM_SECTOR		0x10000
+
+/* modeled costs */
+#define SIM_BYTE_NS		2400		/* USB data rate, about 400KB/s */
+#define SIM_COPY_NS		200			/* 68K copy from the EZ-HOST to RAM */
+#define SIM_FLASH_NS	1000		/* 68K flash programming */
+#define SIM_ERASE_US	300000		/* per 64k block */
+#define SIM_ERASE_MIN_US 300000	/* erase time in the instantaneous mode, the PC polls it every 100ms */
+#define SIM_SUM_NS		480			/* 68K flash checksum, per byte */
+#define SIM_BOOT_US		200000		/* from the reset release to the BIOS */
+#define SIM_CONSOLE_US	2000000		/* skunkRESET gives up on the console after that, even when instantaneous */
+
+/* Jaguar states */
+enum
+{
+	SIM_RESET,			/* held in reset, or booting the BIOS */
+	SIM_BIOS,			/* BIOS reader loop */
+	SIM_ERASE,			/* flash stub erasing */
+	SIM_FLASH,			/* flash stub reader loop */
+	SIM_VERIFY,			/* checksum stub summing */
+	SIM_CONSOLE,		/* a program is running */
+	SIM_HALT			/* a program ended, wait for a reset */
+};
+
+int g_SimXferUs = 1000;
+int g_SimDropEvery = 0;
+
+static bool bSimOpen = false;
+static uchar *ezram = NULL;
+static uchar *jagram = NULL;
+static uchar *flash = NULL;
+static int nSimState;
+static unsigned long long tBusy;		/* the 68K is busy until then */
+static int nWaitEZ;						/* buffer the reader is waiting on */
+static int nPendingEZ;					/* buffer being copied by the 68K, -1 if none */
+static int nPendingStart;				/* start address of that buffer */
+static int nFlashBank;					/* bank selected by the flash stub */
+static int nBootAddr;					/* last program started */
+static int nSumBank;					/* checksum stub parameters */
+static int nSumStart;
+static int nSumLen;
+static int nConsoleStep;
+static unsigned long long tConsole;		/* console producer timeout */
+static unsigned long long tPing;		/* mailbox ping sent */
+static int nPingUs;						/* and answered that much later */
+static uchar SimStage[2][EZ_BLOCKSIZE];	/* upload blocks, one of them may be in flight */
+static int nCurStage;
+static int nFlightEZ = -1;				/* buffer the block in flight goes to, -1 if none */
+static unsigned long long tFlight;		/* it lands then */
+static int nQueued;						/* blocks queued, for g_SimDropEvery */
+static bool bFlightDropped;				/* the block in flight gets lost */
+static bool bFlightFailed;				/* a block got lost, not reported yet */
+
+
+/* EZ-HOST memory is made of little endian words */
+static int Peek(int ez)
+{
+	return ezram[ez] | (ezram[ez+1] << 8);
+}
+
+
+static void Poke(int ez, int val)
+{
+	ezram[ez] = val & 0xff;
+	ezram[ez+1] = (val >> 8) & 0xff;
+}
+
+
+/* middle endian long, like the block trailer */
+static int PeekLong(int ez)
+{
+	return (Peek(ez) << 16) | Peek(ez+2);
+}
+
+
+/* a length word with the high byte set means the buffer is free */
+static bool IsFree(int ez)
+{
+	return (0xff00 == (Peek(ez+0xFEA) & 0xff00));
+}
+
+
+/* scale the modeled delays, none of them in the instantaneous mode */
+static unsigned long long Cost(unsigned long long us)
+{
+	return (g_SimXferUs ? us : 0);
+}
+
+
+/* when a USB transfer started now would be done */
+static unsigned long long TransferEnd(int len)
+{
+	return GetMicroCount() + Cost(g_SimXferUs + ((unsigned long long)len * SIM_BYTE_NS) / 1000);
+}
+
+
+/* wait for a transfer to be done */
+static void SpendUntil(unsigned long long tEnd)
+{
+	while (GetMicroCount() < tEnd)
+	{
+		// spin, the sleep granularity is too coarse for this
+	}
+}
+
+
+/* the USB transfer itself */
+static void SpendTransfer(int len)
+{
+	SpendUntil(TransferEnd(len));
+}
+
+
+/* the BIOS has come up and waits for the first block at $2800 */
+static void BootBios(void)
+{
+	Poke(0x1800+0xFEA, 0xffff);
+	Poke(0x2800+0xFEA, 0xffff);
+
+	// revision and serial number, as the newer BIOSs leave them (BCD, funky byte order)
+	memcpy(ezram+0x2800, "\x57\xfa\x0d\xf0", 4);
+	ezram[0x2800+4] = 0x02;
+	ezram[0x2800+5] = 0x00;
+	ezram[0x2800+6] = 0x03;
+	ezram[0x2800+7] = 0x00;
+	ezram[0x2800+8] = SkunkboardSerial ? (SkunkboardSerial & 0xff) : 0x01;
+	ezram[0x2800+9] = SkunkboardSerial ? (SkunkboardSerial >> 8) : 0x00;
+
+	nSimState = SIM_BIOS;
+	nWaitEZ = 0x2800;
+	nPendingEZ = -1;
+}
+
+
+/* store a byte from a block into the Jaguar address space */
+static void Store(int addr, uchar val)
+{
+	addr &= 0xffffff;
+
+	if (addr < SIM_RAMSIZE)
+	{
+		jagram[addr] = val;
+	}
+	else
+	{
+		if ((SIM_FLASH == nSimState) && (addr >= 0x800000) && (addr < 0x800000+SIM_BANKSIZE))
+		{
+			// programming can only clear bits
+			flash[nFlashBank*SIM_BANKSIZE + addr - 0x800000] &= val;
+		}
+	}
+
+	// anything else is ROM or unmapped, ignore it
+}
+
+
+/* big endian long in the Jaguar RAM */
+static int PeekJag(const uchar *p)
+{
+	return (p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+
+/* run the decompressor stub at addr, returns where it jumps */
+static int Expand(int addr)
+{
+	int src = addr + 0x3e;
+	int dst = PeekJag(jagram + addr + 0x36) & 0xffffff;
+	int n;
+
+	while (src < SIM_RAMSIZE)
+	{
+		n = (signed char)jagram[src++];
+
+		if (n >= 0)
+		{
+			for (n++; (n > 0) && (src < SIM_RAMSIZE); n--)
+			{
+				Store(dst++, jagram[src++]);
+			}
+		}
+		else
+		{
+			if (-128 == n)
+			{
+				break;
+			}
+
+			for (n = 1 - n; (n > 0) && (src < SIM_RAMSIZE); n--)
+			{
+				Store(dst++, jagram[src]);
+			}
+			src++;
+		}
+	}
+
+	if (g_OptVerbose)
+	{
+		printf("[sim] decompressor stub, expanded to $%06X-$%06X\n", PeekJag(jagram + addr + 0x36) & 0xffffff, dst - 1);
+	}
+
+	return PeekJag(jagram + addr + 0x3a) & 0xffffff;
+}
+
+
+/* run the BSS clearing stub at addr, returns where it jumps */
+static int ClearBss(int addr)
+{
+	int list = addr + 0x42;
+	int start, len;
+
+	for (; list + 8 <= SIM_RAMSIZE; list += 8)
+	{
+		start = PeekJag(jagram + list) & 0xffffff;
+		len = PeekJag(jagram + list + 4);
+
+		if (!len)
+		{
+			break;
+		}
+
+		if (g_OptVerbose)
+		{
+			printf("[sim] BSS clearing stub, $%06X-$%06X\n", start, start + len - 1);
+		}
+
+		for (; len > 0; len--)
+		{
+			Store(start++, 0);
+		}
+	}
+
+	return PeekJag(jagram + addr + 0x3e) & 0xffffff;
+}
+
+
+/* the block at start was booted - find out what it is */
+static void Boot(int start)
+{
+	int addr = start & 0xffffff;
+	int nBlocks;
+	uchar *p;
+
+	nBootAddr = addr;
+
+	// flash stub: move.l #blocks,d1 / move.l d1,$3FF0.w
+	p = jagram + addr;
+	if ((SIM_BIOS == nSimState) && (addr < SIM_RAMSIZE-10) && (p[0] == 0x22) && (p[1] == 0x3c) && (p[6] == 0x21) && (p[7] == 0xc1) && (p[8] == 0x3f) && (p[9] == 0xf0))
+	{
+		nBlocks = (p[2] << 24) | (p[3] << 16) | (p[4] << 8) | p[5];
+		nFlashBank = (nBlocks & 0x40000000) ? 1 : 0;
+		nBlocks &= 0xff;
+		if (nBlocks > SIM_BANKSIZE/SIM_SECTOR)
+		{
+			nBlocks = SIM_BANKSIZE/SIM_SECTOR;
+		}
+
+		if (g_OptVerbose)
+		{
+			printf("[sim] flash stub, erasing %d blocks of bank %d\n", nBlocks, nFlashBank+1);
+		}
+
+		memset(flash + nFlashBank*SIM_BANKSIZE, 0xff, nBlocks*SIM_SECTOR);
+		Poke(0x1800+0xFEA, 0);
+		Poke(0x2800+0xFEA, 0);
+		// even an instantaneous erase has to last long enough for the PC to notice it started
+		tBusy = GetMicroCount() + (g_SimXferUs ? (unsigned long long)nBlocks * SIM_ERASE_US : SIM_ERASE_MIN_US);
+		nSimState = SIM_ERASE;
+		return;
+	}
+
+	// checksum stub: move.w #$2700,sr / lea $C00000,a1 / lea $800000,a2 / move.w #$4001,(a1) / move.w bank,(a1) / movea.l start,a0 / move.l length,d7
+	if ((addr < SIM_RAMSIZE-0x26) && !memcmp(p, "\x46\xfc\x27\x00\x43\xf9\x00\xc0\x00\x00\x45\xf9\x00\x80\x00\x00\x32\xbc\x40\x01\x32\xb9", 22) && (p[0x1a] == 0x20) && (p[0x1b] == 0x79) && (p[0x20] == 0x2e) && (p[0x21] == 0x39))
+	{
+		// the parameters are where the instructions read them, the bank is $4BA0 or $4BA1
+		nSumBank = (0xa1 == jagram[(PeekJag(p+0x16) & 0xffff) + 1]) ? 1 : 0;
+		nSumStart = PeekJag(jagram + (PeekJag(p+0x1c) & 0xffff));
+		nSumLen = PeekJag(jagram + (PeekJag(p+0x22) & 0xffff));
+
+		if (g_OptVerbose)
+		{
+			printf("[sim] checksum stub, $%06X-$%06X of bank %d\n", nSumStart, nSumStart + nSumLen - 1, nSumBank+1);
+		}
+
+		tBusy = GetMicroCount() + Cost(((unsigned long long)nSumLen * SIM_SUM_NS) / 1000);
+		nSimState = SIM_VERIFY;
+		return;
+	}
+
+	// decompressor stub: move.w sr,-(sp) / move.w #$2700,sr / lea stream(pc),a0 / movea.l dest(pc),a1
+	if ((addr < SIM_RAMSIZE-0x3e) && !memcmp(p, "\x40\xe7\x46\xfc\x27\x00\x41\xfa\x00\x36\x22\x7a\x00\x2a", 14))
+	{
+		nBootAddr = addr = Expand(addr);
+	}
+
+	// BSS clearing stub: move.w sr,-(sp) / move.w #$2700,sr / lea ranges(pc),a0 / movea.l (a0)+,a1 / move.l (a0)+,d0
+	if ((addr < SIM_RAMSIZE-0x42) && !memcmp(p, "\x40\xe7\x46\xfc\x27\x00\x41\xfa\x00\x3a\x22\x58\x20\x18", 14))
+	{
+		nBootAddr = addr = ClearBss(addr);
+	}
+
+	if (g_OptVerbose)
+	{
+		printf("[sim] program started at $%06X\n", addr);
+	}
+
+	nSimState = SIM_CONSOLE;
+	nConsoleStep = 0;
+	tConsole = GetMicroCount() + SIM_CONSOLE_US;
+}
+
+
+/* BIOS or flash stub reader - returns false if there is nothing to do */
+static bool ReadBlock(void)
+{
+	int b = nWaitEZ;
+	int base, len, next, idx;
+
+	if (IsFree(b))
+	{
+		return false;
+	}
+
+	base = PeekLong(b+0xFE0);
+	nPendingStart = PeekLong(b+0xFE4);
+	next = Peek(b+0xFE8);
+	len = Peek(b+0xFEA);
+
+	if (len > 4064)
+	{
+		len = 4064;
+	}
+
+	// blocks are made of byte swapped 68K words
+	for (idx = 0; idx < len; idx++)
+	{
+		Store(base + idx, ezram[b + (idx ^ 1)]);
+	}
+
+	nPendingEZ = b;
+	nWaitEZ = ((0x1800 == next) || (0x2800 == next)) ? next : 0x2800;
+	tBusy = GetMicroCount() + Cost(((unsigned long long)len * ((SIM_FLASH == nSimState) ? SIM_FLASH_NS : SIM_COPY_NS)) / 1000);
+
+	return true;
+}
+
+
+/* the 68K is done with the pending block */
+static void EndBlock(void)
+{
+	int b = nPendingEZ;
+
+	nPendingEZ = -1;
+
+	if (-1 == nPendingStart)
+	{
+		Poke(b+0xFEA, 0xffff);
+	}
+	else
+	{
+		if ((-2 == nPendingStart) && (SIM_FLASH == nSimState))
+		{
+			// first half of a 6MB flash, back to the BIOS, which goes on with
+			// the next block of the chain (EndUpload's dummy block)
+			Poke(b+0xFEA, 0xffff);
+			nSimState = SIM_BIOS;
+		}
+		else
+		{
+			Poke(b+0xFEA, 0);
+			Boot(nPendingStart);
+		}
+	}
+}
+
+
+/* write a console block in the first free buffer, as the skunk library does */
+static void ConsoleWrite(int b, const uchar *data, int len, int nLenWord)
+{
+	int idx;
+
+	for (idx = 0; idx < len; idx++)
+	{
+		ezram[b + (idx ^ 1)] = data[idx];
+	}
+
+	Poke(b+0xFEA, nLenWord);
+}
+
+
+/* the console producer - returns false while it waits on the PC */
+static bool ConsoleStep(void)
+{
+	char szText[120];
+	int b;
+
+	switch (nConsoleStep)
+	{
+		// skunkRESET - wait for the PC to clear both buffers
+	case 0:
+		if (IsFree(0x1800) && IsFree(0x2800))
+		{
+			nConsoleStep = 1;
+			return true;
+		}
+		break;
+
+		// skunkMBOXPING, 4 bytes
+	case 1:
+		if (0xffff == Peek(MBOX_JAG+MBOX_CTRL))
+		{
+			Poke(MBOX_PC+MBOX_CTRL, 0xffff);	// an answer to an older ping is dropped, before this one is sent
+			ConsoleWrite(MBOX_JAG, (uchar*)"\x12\x34\x56\x78", 4, 0);
+			Poke(MBOX_JAG+MBOX_CTRL, (MBOX_PING << 8) | 4);
+			tPing = GetMicroCount();
+			nConsoleStep = 2;
+			return true;
+		}
+		break;
+
+		// wait for the answer, and free the slot
+	case 2:
+		if (0xff00 != (Peek(MBOX_PC+MBOX_CTRL) & 0xff00))
+		{
+			nPingUs = (0 == memcmp(ezram+MBOX_PC, "\x34\x12\x78\x56", 4)) ? (int)(GetMicroCount() - tPing) : -1;
+			Poke(MBOX_PC+MBOX_CTRL, 0xffff);
+			nConsoleStep = 3;
+			return true;
+		}
+		break;
+
+		// skunkCONSOLEWRITE
+	case 3:
+		b = IsFree(0x1800) ? 0x1800 : (IsFree(0x2800) ? 0x2800 : 0);
+		if (b)
+		{
+			sprintf(szText, "Hello from the simulated Jaguar, started at $%06X, mailbox ping %s %dus\r\n", nBootAddr, (nPingUs < 0) ? "CORRUPTED" : "answered in", nPingUs);
+			ConsoleWrite(b, (uchar*)szText, (int)strlen(szText)+1, (int)strlen(szText)+1);
+			nConsoleStep = 4;
+			tConsole = GetMicroCount() + SIM_CONSOLE_US;
+			return true;
+		}
+		break;
+
+		// skunkCONSOLECLOSE - wait for both buffers, then close
+	case 4:
+		if (IsFree(0x1800) && IsFree(0x2800))
+		{
+			ConsoleWrite(0x1800, (uchar*)"\xff\xff\x00\x01", 4, 4);
+			nConsoleStep = 5;
+			tConsole = GetMicroCount() + SIM_CONSOLE_US;
+			return true;
+		}
+		break;
+
+		// wait for the PC acknowledge
+	case 5:
+		if (IsFree(0x1800))
+		{
+			nSimState = SIM_HALT;
+			return true;
+		}
+		break;
+	}
+
+	// the library gives up waiting eventually
+	if (GetMicroCount() > tConsole)
+	{
+		if (g_OptVerbose)
+		{
+			printf("[sim] console timed out\n");
+		}
+
+		nSimState = SIM_HALT;
+		return true;
+	}
+
+	return false;
+}
+
+
+/* the checksum stub is done: the sum of the longs and the sum of the sums, */
+/* per 64k block of the range, in a table at $1800 */
+static void SumFlash(void)
+{
+	uchar table[SIM_BANKSIZE/SIM_SECTOR*8];
+	unsigned int nSum, nSumSum;
+	int addr, end, nLen = 0;
+	uchar *f;
+
+	for (addr = nSumStart; (addr < nSumStart + nSumLen) && (nLen < (int)sizeof(table)); nLen += 8)
+	{
+		end = (addr | (SIM_SECTOR-1)) + 1;
+		if (end > nSumStart + nSumLen)
+		{
+			end = nSumStart + nSumLen;
+		}
+
+		for (nSum = 0, nSumSum = 0; addr < end; addr += 4)
+		{
+			f = flash + nSumBank*SIM_BANKSIZE + ((addr - 0x800000) & (SIM_BANKSIZE-1));
+			nSum += (unsigned int)PeekJag(f);
+			nSumSum += nSum;
+		}
+
+		table[nLen] = nSum >> 24;
+		table[nLen+1] = nSum >> 16;
+		table[nLen+2] = nSum >> 8;
+		table[nLen+3] = nSum;
+		table[nLen+4] = nSumSum >> 24;
+		table[nLen+5] = nSumSum >> 16;
+		table[nLen+6] = nSumSum >> 8;
+		table[nLen+7] = nSumSum;
+	}
+
+	ConsoleWrite(0x1800, table, nLen, nLen);
+	nSimState = SIM_HALT;
+}
+
+
+/* run the Jaguar up to now */
+static void Run(void)
+{
+	for (;;)
+	{
+		if (GetMicroCount() < tBusy)
+		{
+			return;
+		}
+
+		switch (nSimState)
+		{
+		case SIM_RESET:
+			if (0 == tBusy)
+			{
+				// reset still asserted
+				return;
+			}
+			BootBios();
+			break;
+
+		case SIM_BIOS:
+		case SIM_FLASH:
+			if (-1 != nPendingEZ)
+			{
+				EndBlock();
+			}
+			else
+			{
+				if (!ReadBlock())
+				{
+					return;
+				}
+			}
+			break;
+
+		case SIM_ERASE:
+			Poke(0x1800+0xFEA, 0xffff);
+			Poke(0x2800+0xFEA, 0xffff);
+			nSimState = SIM_FLASH;
+			nWaitEZ = 0x2800;
+			break;
+
+		case SIM_VERIFY:
+			SumFlash();
+			break;
+
+		case SIM_CONSOLE:
+			if (!ConsoleStep())
+			{
+				return;
+			}
+			break;
+
+		default:
+			return;
+		}
+	}
+}
+
+
+static bool SimOpen(bool fInstallTurbo)
+{
+	if (NULL == ezram)
+	{
+		ezram = (uchar*)calloc(1, SIM_EZSIZE);
+		jagram = (uchar*)calloc(1, SIM_RAMSIZE);
+		flash = (uchar*)malloc(2*SIM_BANKSIZE);
+
+		if ((NULL == ezram) || (NULL == jagram) || (NULL == flash))
+		{
+			bye("Error: Not enough memory for the simulated Skunkboard.");
+		}
+
+		memset(flash, 0xff, 2*SIM_BANKSIZE);
+		tBusy = 0;
+		BootBios();
+	}
+
+	if (g_OptVerbose)
+	{
+		printf("Using the simulated Skunkboard\n");
+	}
+
+	bSimOpen = true;
+	return true;
+}
+
+
+/* the block in flight reaches the board, or gets lost */
+static void Land(void)
+{
+	if (-1 == nFlightEZ)
+	{
+		return;
+	}
+
+	SpendUntil(tFlight);
+	Run();
+
+	if (bFlightDropped)
+	{
+		bFlightFailed = true;
+	}
+	else
+	{
+		memcpy(ezram+nFlightEZ, SimStage[1-nCurStage], EZ_BLOCKSIZE);
+		Run();
+	}
+
+	nFlightEZ = -1;
+}
+
+
+/* the board state is kept, like a real one between two runs */
+static void SimClose(void)
+{
+	Land();
+	bSimOpen = false;
+}
+
+
+static bool SimIsOpen(void)
+{
+	return bSimOpen;
+}
+
+
+static int SimRead(int ez, uchar *buf, int len)
+{
+	if ((ez < 0) || (ez+len > SIM_EZSIZE))
+	{
+		return -1;
+	}
+
+	Land();
+	SpendTransfer(len);
+	Run();
+	memcpy(buf, ezram+ez, len);
+
+	return len;
+}
+
+
+static int SimWrite(int ez, const uchar *buf, int len)
+{
+	if ((ez < 0) || (ez+len > SIM_EZSIZE))
+	{
+		return -1;
+	}
+
+	Land();
+	SpendTransfer(len);
+	Run();
+	memcpy(ezram+ez, buf, len);
+	Run();
+
+	return len;
+}
+
+
+/* only the reset through the scan codes is of interest */
+static int SimScan(int value, const uchar *buf, int len)
+{
+	Land();
+	SpendTransfer(len);
+	Run();
+
+	if ((10 == value) && (10 == len) && (0x28 == buf[5]) && (0xc0 == buf[6]))
+	{
+		if (buf[7] & 2)
+		{
+			nSimState = SIM_RESET;
+			nPendingEZ = -1;
+			tBusy = 0;
+		}
+		else
+		{
+			tBusy = GetMicroCount() + Cost(SIM_BOOT_US);
+			if (0 == tBusy)
+			{
+				BootBios();
+			}
+		}
+	}
+
+	return len;
+}
+
+
+/* the stage not in flight */
+static uchar *SimGetBlock(void)
+{
+	return SimStage[nCurStage];
+}
+
+
+/* the previous block lands, this one goes in flight */
+/* returns false if the previous one got lost */
+static bool SimQueueBlock(int ez, uchar *block)
+{
+	bool bRet;
+
+	Land();
+	bRet = !bFlightFailed;
+	bFlightFailed = false;
+
+	if ((ez < 0) || (ez+EZ_BLOCKSIZE > SIM_EZSIZE))
+	{
+		return false;
+	}
+
+	if (block != SimStage[nCurStage])
+	{
+		memcpy(SimStage[nCurStage], block, EZ_BLOCKSIZE);
+	}
+
+	nFlightEZ = ez;
+	tFlight = TransferEnd(EZ_BLOCKSIZE);
+	bFlightDropped = (g_SimDropEvery > 0) && (0 == (++nQueued % g_SimDropEvery));
+	nCurStage = 1 - nCurStage;
+
+	return bRet;
+}
+
+
+/* returns false if the block in flight, or one before, got lost */
+static bool SimFlush(void)
+{
+	bool bRet;
+
+	Land();
+	bRet = !bFlightFailed;
+	bFlightFailed = false;
+
+	return bRet;
+}
+
+
+/* the simulated board never leaves */
+static bool SimWaitArrival(int nTimeoutMs)
+{
+	return true;
+}
+
+
+static bool SimReopen(void)
+{
+	return SimOpen(true);
+}
+
+
+static bool SimLost(void)
+{
+	return false;
+}
+
+
+EZTRANSPORT EZSim =
+{
+	"simulated Skunkboard",
+	SimOpen,
+	SimClose,
+	SimIsOpen,
+	SimRead,
+	SimWrite,
+	SimScan,
+	SimGetBlock,
+	SimQueueBlock,
+	SimFlush,
+	SimWaitArrival,
+	SimReopen,
+	SimLost
+};
@@ -0,0 +1,111 @@
+/* jcp_swap.c : byte swap of the 68K words
+
+	The EZ-HOST blocks carry the 68K words with their bytes swapped (the
+	CPLD does not byteswap the data regions), so each byte of an upload
+	and of a console block goes through here.
+
+	The kernel is picked at build time, from the instruction sets the
+	compiler targets: AVX2, SSE2 (always there for the 64 bits x86 builds)
+	or NEON, and a plain C loop for the others and for the tail.
+*/
+
+#include <string.h>
+#include "jcp2.h"
+#include "jcp_swap.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define SWAP_AVX2
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#include <emmintrin.h>
+#define SWAP_SSE2
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__) || defined(_M_ARM64)
+#include <arm_neon.h>
+#define SWAP_NEON
+#endif
+
+
+/* plain C, one word at a time */
+void SwapBytesScalar(uchar *dst, const uchar *src, int len)
+{
+	uchar x;
+	int i;
+
+	for (i = 0; i + 1 < len; i += 2)
+	{
+		x = src[i];
+		dst[i] = src[i+1];
+		dst[i+1] = x;
+	}
+
+	// odd length, the last byte goes high in a word padded with 0
+	if (len & 1)
+	{
+		dst[len] = src[len-1];
+		dst[len-1] = 0;
+	}
+}
+
+
+#if defined(SWAP_AVX2)
+
+const char *g_pszSwapKernel = "AVX2";
+
+void SwapBytes(uchar *dst, const uchar *src, int len)
+{
+	__m256i v;
+	int i;
+
+	for (i = 0; i + 32 <= len; i += 32)
+	{
+		v = _mm256_loadu_si256((const __m256i*)(src + i));
+		_mm256_storeu_si256((__m256i*)(dst + i), _mm256_or_si256(_mm256_slli_epi16(v, 8), _mm256_srli_epi16(v, 8)));
+	}
+
+	SwapBytesScalar(dst + i, src + i, len - i);
+}
+
+#elif defined(SWAP_SSE2)
+
+const char *g_pszSwapKernel = "SSE2";
+
+void SwapBytes(uchar *dst, const uchar *src, int len)
+{
+	__m128i v;
+	int i;
+
+	for (i = 0; i + 16 <= len; i += 16)
+	{
+		v = _mm_loadu_si128((const __m128i*)(src + i));
+		_mm_storeu_si128((__m128i*)(dst + i), _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8)));
+	}
+
+	SwapBytesScalar(dst + i, src + i, len - i);
+}
+
+#elif defined(SWAP_NEON)
+
+const char *g_pszSwapKernel = "NEON";
+
+void SwapBytes(uchar *dst, const uchar *src, int len)
+{
+	int i;
+
+	for (i = 0; i + 16 <= len; i += 16)
+	{
+		vst1q_u8(dst + i, vrev16q_u8(vld1q_u8(src + i)));
+	}
+
+	SwapBytesScalar(dst + i, src + i, len - i);
+}
+
+#else
+
+const char *g_pszSwapKernel = "scalar";
+
+void SwapBytes(uchar *dst, const uchar *src, int len)
+{
+	SwapBytesScalar(dst, src, len);
+}
+
+#endif
@@ -0,0 +1,14 @@
+#ifndef __JCP_SWAP_H
+#define __JCP_SWAP_H
+
+/* Byte swap of the 68K words, between the PC order and the 'middle endian'
+   order of the EZ-HOST blocks (the swap is its own inverse).
+   len is rounded up to even, an odd last byte is paired with a 0, so dst
+   must hold the rounded length. dst may be src, for an in place swap. */
+
+extern const char *g_pszSwapKernel;		/* name of the vector kernel built in */
+
+void SwapBytes(uchar *dst, const uchar *src, int len);
+void SwapBytesScalar(uchar *dst, const uchar *src, int len);	/* reference, for the benchmark */
+
+#endif
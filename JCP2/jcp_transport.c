@@ -0,0 +1,584 @@
+/* jcp_transport.c : EZ-HOST access through libusb 1.0 or libusb 0.1
+
+	Only one of the USB libraries is built in, selected by LIBUSB_1 like
+	the rest of jcp2. The simulated board lives in jcp_sim.c.
+
+	With libusb 1.0, blocks are queued as asynchronous control transfers:
+	while one buffer is being drained by the 68K, the next block is already
+	swapped and queued behind it.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#if defined(WIN32) || defined(WIN64)
+#ifdef LIBUSB_1
+#include "libusb-1.0/libusb.h"
+#else
+#include "winusb.h"
+#endif
+#else
+#include <unistd.h>
+#ifdef LIBUSB_1
+#include <libusb-1.0/libusb.h>
+#else
+#include <usb.h>
+#endif
+#endif
+#include "jcp2.h"
+#include "jcp_transport.h"
+#include "turbow.h"
+
+/* Skunkboard USB identifiers */
+#define EZ_VENDOR	0x4b4
+#define EZ_PRODUCT	0x7200
+
+EZTRANSPORT *g_pEZ = &EZUsb;
+EZSTATS g_EZStats;
+
+static bool g_bLost = false;			/* the last transfer failed because the board left the bus */
+
+#ifdef LIBUSB_1
+libusb_device_handle *udev = NULL;
+libusb_context *ctx = NULL;
+
+/* Asynchronous block staging. Each stage holds the control setup packet */
+/* followed by the 4080 bytes block. */
+#define NUM_UPLOAD_STAGES 2
+typedef struct
+{
+	uchar buf[LIBUSB_CONTROL_SETUP_SIZE + EZ_BLOCKSIZE];
+	struct libusb_transfer *xfer;
+	int nDone;							/* non-zero once the transfer left the host */
+	bool bFailed;						/* set by the completion callback on error */
+} UPLOADSTAGE;
+UPLOADSTAGE g_Stage[NUM_UPLOAD_STAGES];
+int nCurStage = 0;
+bool g_StageFailed = false;				/* a queued block failed, reported by the next QueueBlock or Flush */
+
+/* where the board opened last is, to find the same one again */
+static int g_nLastBus = 0;
+static uint8_t g_LastPorts[8];
+static int g_nLastPorts = 0;
+#else
+usb_dev_handle *udev = NULL;
+uchar g_Block[EZ_BLOCKSIZE];
+
+static char g_szLastBusName[64] = "";
+#endif
+
+
+/* Prepare the USB library */
+bool EZInit(void)
+{
+#ifdef LIBUSB_1
+	if (libusb_init(&ctx))
+	{
+		return false;
+	}
+
+	libusb_set_debug(ctx, LIBUSB_LOG_LEVEL_NONE);
+#endif
+	return true;
+}
+
+
+/* Release the USB library */
+void EZExit(void)
+{
+	if (EZIsOpen())
+	{
+		EZClose();
+	}
+
+#ifdef LIBUSB_1
+	libusb_exit(ctx);
+	ctx = NULL;
+#endif
+}
+
+
+#ifdef LIBUSB_1
+/* Completion callback for a queued block */
+static void LIBUSB_CALL StageComplete(struct libusb_transfer *xfer)
+{
+	UPLOADSTAGE *pStage = (UPLOADSTAGE*)xfer->user_data;
+
+	if ((xfer->status != LIBUSB_TRANSFER_COMPLETED) || (xfer->actual_length != EZ_BLOCKSIZE))
+	{
+		pStage->bFailed = true;
+		g_bLost = (LIBUSB_TRANSFER_NO_DEVICE == xfer->status);
+	}
+
+	pStage->nDone = 1;
+}
+
+
+/* Wait until a queued block has left the host */
+static void WaitForStage(UPLOADSTAGE *pStage)
+{
+	// never queued yet
+	if (NULL == pStage->xfer)
+	{
+		return;
+	}
+
+	while (!pStage->nDone)
+	{
+		if (libusb_handle_events_completed(ctx, &pStage->nDone) < 0)
+		{
+			// can't pump events, the transfer will still time out on its own
+			Sleep(1);
+		}
+	}
+
+	if (pStage->bFailed)
+	{
+		pStage->bFailed = false;
+		g_StageFailed = true;
+	}
+}
+#endif
+
+
+#ifdef LIBUSB_1
+/* Is it where the board opened last was, same bus and same ports path */
+static bool IsSameBoard(libusb_device *device)
+{
+	uint8_t PortList[8];
+
+	if (0 == g_nLastBus)
+	{
+		// never opened, any board will do
+		return true;
+	}
+
+	return (libusb_get_bus_number(device) == g_nLastBus) && (libusb_get_port_numbers(device, PortList, sizeof(PortList)) == g_nLastPorts) &&
+		!memcmp(PortList, g_LastPorts, g_nLastPorts);
+}
+#endif
+
+
+/* Transfer result, a board that left the bus is told apart from a failed transfer */
+static int UsbResult(int ret)
+{
+	if (ret < 0)
+	{
+#ifdef LIBUSB_1
+		g_bLost = (LIBUSB_ERROR_NO_DEVICE == ret);
+#elif defined(ENODEV)
+		g_bLost = (-ENODEV == ret);
+#endif
+	}
+
+	return ret;
+}
+
+
+/* Locate the Jaguar on the USB bus, open it, get a handle, and upload the turboW tool */
+/* bSame restricts the search to the board opened last, and does not fail on a board not ready */
+static bool UsbFind(bool fInstallTurbo, bool bSame)
+{
+#ifdef LIBUSB_1
+	struct libusb_device_descriptor desc;
+	libusb_device **devlist;
+	libusb_device *device;
+	uint8_t PortList[256];
+	ssize_t cnt;
+	unsigned char SerBuf[12];
+
+	udev = NULL;
+	g_bLost = false;
+
+	if ((cnt = libusb_get_device_list(ctx, &devlist)) >= 0)
+	{
+		for (ssize_t i = 0; (i < cnt) && (NULL == udev); i++)
+		{
+			device = devlist[i];
+
+			if ((!USBBus || (libusb_get_bus_number(device) == USBBus)) && (!bSame || IsSameBoard(device)))
+			{
+				int j = libusb_get_port_numbers(device, PortList, sizeof(PortList));
+
+				while ((j--) && (NULL == udev))
+				{
+					if (!USBPort || (PortList[j] == USBPort))
+					{
+						if (!libusb_get_device_descriptor(device, &desc))
+						{
+							if ((desc.idVendor == EZ_VENDOR) && (desc.idProduct == EZ_PRODUCT))
+							{
+								if (!libusb_open(device, &udev))
+								{
+									if (!SkunkboardSerial || ((libusb_control_transfer(udev, 0xC0, 0xff, 4, 0x2800, SerBuf, 12, ComTimeout) == 12) && (SerBuf[8] == (SkunkboardSerial & 0x00ff)) && (SerBuf[9] == ((SkunkboardSerial & 0xff00) >> 8))))
+									{
+										if (fInstallTurbo)
+										{
+											// load turbow from array
+											if (libusb_control_transfer(udev, 0x40, 0xff, 0, 0x304c, (uchar*)turbow, SIZE_OF_TURBOW, ComTimeout) != SIZE_OF_TURBOW)
+											{
+												printf("Failed to install turbow.bin!\n");
+											}
+											else
+											{
+												if (g_OptVerbose)
+												{
+													printf("Installed turbow.bin\n");
+												}
+											}
+										}
+									}
+									else
+									{
+										libusb_close(udev);
+										udev = NULL;
+									}
+								}
+								else
+								{
+									// just plugged back, it may not be ready yet
+									if (!bSame)
+									{
+										bye("Error: Skunkboard found, but can't open EZ-HOST. In use or not ready? ");
+									}
+								}
+							}
+						}
+					}
+				}
+			}
+		}
+
+		libusb_free_device_list(devlist, 1);
+	}
+
+	if (NULL != udev)
+	{
+		device = libusb_get_device(udev);
+		g_nLastBus = libusb_get_bus_number(device);
+		g_nLastPorts = libusb_get_port_numbers(device, g_LastPorts, sizeof(g_LastPorts));
+	}
+#else
+	struct usb_bus *bus;
+	struct usb_device *dev;
+	int nTriesLeft = bSame ? 1 : 3;
+	int ret;
+	unsigned char SerBuf[12];
+
+	udev = NULL;
+	g_bLost = false;
+
+	while (nTriesLeft--)
+	{
+		usb_init();
+		usb_set_debug(0);
+		usb_find_busses();
+		usb_find_devices();
+
+		for (bus = usb_get_busses(); bus; bus = bus->next)
+		{
+			if ((!strlen(USBBusName) || !strcmp(USBBusName, bus->dirname)) && (!bSame || !strlen(g_szLastBusName) || !strcmp(g_szLastBusName, bus->dirname)))
+			{
+				for (dev = bus->devices; dev; dev = dev->next)
+				{
+					if ((dev->descriptor.idVendor == EZ_VENDOR) && (dev->descriptor.idProduct == EZ_PRODUCT))
+					{
+						if (!(udev = usb_open(dev)))
+						{
+							if (!bSame)
+							{
+								bye("Error: - Found, but can't open, EZ-HOST. In use or not ready? ");
+							}
+						}
+						else
+						{
+							if (!SkunkboardSerial || ((usb_control_msg(udev, 0xC0, 0xff, 4, 0x2800, (char*)SerBuf, 12, ComTimeout) == 12) && (SerBuf[8] == (SkunkboardSerial & 0x00ff)) && (SerBuf[9] == ((SkunkboardSerial & 0xff00)>>8))))
+							{
+								if (fInstallTurbo)
+								{
+									// load turbow from array
+									ret = usb_control_msg(udev, 0x40, 0xff, 0, 0x304c, (char*)turbow, SIZE_OF_TURBOW, ComTimeout);
+
+									if (ret < 1)
+									{
+										printf("Failed to install turbow.bin!\n");
+									}
+									else
+									{
+										if (g_OptVerbose)
+										{
+											printf("Installed turbow.bin: %d scan codes sent\n", ret);
+										}
+									}
+								}
+
+								strncpy(g_szLastBusName, bus->dirname, sizeof(g_szLastBusName) - 1);
+								return true;
+							}
+							else
+							{
+								usb_close(udev);
+								udev = NULL;
+							}
+						}
+					}
+				}
+			}
+		}
+
+		if (udev == NULL)
+		{
+			if (nTriesLeft > 0)
+			{
+				printf(".. retrying ..\n");
+				Sleep(1000);
+			}
+		}
+	}
+#endif
+
+	return (NULL != udev);
+}
+
+
+static bool UsbOpen(bool fInstallTurbo)
+{
+	return UsbFind(fInstallTurbo, false);
+}
+
+
+/* Open the board opened last again, with turbow */
+static bool UsbReopen(void)
+{
+	return UsbFind(true, true);
+}
+
+
+/* Did the last failure come from the board leaving the bus */
+static bool UsbLost(void)
+{
+	return g_bLost;
+}
+
+
+/* Close the handle - queued blocks are dropped */
+static void UsbClose(void)
+{
+#ifdef LIBUSB_1
+	int idx;
+
+	for (idx = 0; idx < NUM_UPLOAD_STAGES; idx++)
+	{
+		if (NULL != g_Stage[idx].xfer)
+		{
+			if (!g_Stage[idx].nDone)
+			{
+				libusb_cancel_transfer(g_Stage[idx].xfer);
+				WaitForStage(&g_Stage[idx]);
+			}
+
+			libusb_free_transfer(g_Stage[idx].xfer);
+			g_Stage[idx].xfer = NULL;
+		}
+	}
+
+	g_StageFailed = false;
+
+	if (NULL != udev)
+	{
+		libusb_close(udev);
+	}
+#else
+	if (NULL != udev)
+	{
+		usb_close(udev);
+	}
+#endif
+
+	udev = NULL;
+}
+
+
+static bool UsbIsOpen(void)
+{
+	return (NULL != udev);
+}
+
+
+static int UsbRead(int ez, uchar *buf, int len)
+{
+#ifdef LIBUSB_1
+	return UsbResult(libusb_control_transfer(udev, 0xC0, 0xff, 4, ez, buf, len, ComTimeout));
+#else
+	return UsbResult(usb_control_msg(udev, 0xC0, 0xff, 4, ez, (char*)buf, len, ComTimeout));
+#endif
+}
+
+
+static int UsbWrite(int ez, const uchar *buf, int len)
+{
+#ifdef LIBUSB_1
+	return UsbResult(libusb_control_transfer(udev, 0x40, 0xfe, 4080, ez, (uchar*)buf, len, ComTimeout));
+#else
+	return UsbResult(usb_control_msg(udev, 0x40, 0xfe, 4080, ez, (char*)buf, len, ComTimeout));
+#endif
+}
+
+
+static int UsbScan(int value, const uchar *buf, int len)
+{
+#ifdef LIBUSB_1
+	return UsbResult(libusb_control_transfer(udev, 0x40, 0xff, value, 0x304C, (uchar*)buf, len, ComTimeout));
+#else
+	return UsbResult(usb_control_msg(udev, 0x40, 0xff, value, 0x304C, (char*)buf, len, ComTimeout));
+#endif
+}
+
+
+/* Get the next stage, once the block it held has left the host */
+static uchar *UsbGetBlock(void)
+{
+#ifdef LIBUSB_1
+	UPLOADSTAGE *pStage = &g_Stage[nCurStage];
+
+	WaitForStage(pStage);
+	return pStage->buf + LIBUSB_CONTROL_SETUP_SIZE;
+#else
+	return g_Block;
+#endif
+}
+
+
+/* Queue the block, and go prepare the next block while this one is moving */
+static bool UsbQueueBlock(int ez, uchar *block)
+{
+#ifdef LIBUSB_1
+	UPLOADSTAGE *pStage = &g_Stage[nCurStage];
+	bool bRet = !g_StageFailed;
+
+	g_StageFailed = false;
+	nCurStage = (nCurStage + 1) % NUM_UPLOAD_STAGES;
+
+	if (NULL == pStage->xfer)
+	{
+		if (NULL == (pStage->xfer = libusb_alloc_transfer(0)))
+		{
+			bye("Error: Can't allocate USB transfer.");
+		}
+	}
+
+	libusb_fill_control_setup(pStage->buf, 0x40, 0xfe, 4080, ez, EZ_BLOCKSIZE);
+	libusb_fill_control_transfer(pStage->xfer, udev, pStage->buf, StageComplete, pStage, ComTimeout);
+	pStage->nDone = 0;
+	pStage->bFailed = false;
+
+	if (UsbResult(libusb_submit_transfer(pStage->xfer)) < 0)
+	{
+		pStage->nDone = 1;
+		bRet = false;
+	}
+
+	return bRet;
+#else
+	return (UsbWrite(ez, block, EZ_BLOCKSIZE) == EZ_BLOCKSIZE);
+#endif
+}
+
+
+/* Wait for all the queued blocks to be sent */
+static bool UsbFlush(void)
+{
+#ifdef LIBUSB_1
+	int idx;
+	bool bRet;
+
+	for (idx = 0; idx < NUM_UPLOAD_STAGES; idx++)
+	{
+		WaitForStage(&g_Stage[idx]);
+	}
+
+	bRet = !g_StageFailed;
+	g_StageFailed = false;
+
+	return bRet;
+#else
+	return true;
+#endif
+}
+
+
+#ifdef LIBUSB_1
+/* Hotplug callback, a Skunkboard was plugged or is there already */
+static int LIBUSB_CALL UsbArrived(libusb_context *pCtx, libusb_device *device, libusb_hotplug_event event, void *pArg)
+{
+	*(int*)pArg = 1;
+	return 0;
+}
+#endif
+
+
+/* Wait for a Skunkboard to be on the bus, up to nTimeoutMs */
+/* returns false when it can't be told, without hotplug support */
+static bool UsbWaitArrival(int nTimeoutMs)
+{
+#ifdef LIBUSB_1
+	libusb_hotplug_callback_handle hArrival;
+	unsigned long long tNow, tEnd;
+	struct timeval tv;
+	int nArrived = 0;
+
+	if (!libusb_has_capability(LIBUSB_CAP_HAS_HOTPLUG))
+	{
+		return false;
+	}
+
+	// a board already there is reported on the spot
+	if (libusb_hotplug_register_callback(ctx, LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED, LIBUSB_HOTPLUG_ENUMERATE, EZ_VENDOR, EZ_PRODUCT,
+		LIBUSB_HOTPLUG_MATCH_ANY, UsbArrived, &nArrived, &hArrival) != LIBUSB_SUCCESS)
+	{
+		return false;
+	}
+
+	tEnd = GetMicroCount() + (unsigned long long)nTimeoutMs * 1000;
+
+	while ((!nArrived) && ((tNow = GetMicroCount()) < tEnd))
+	{
+		tv.tv_sec = (long)((tEnd - tNow) / 1000000);
+		tv.tv_usec = (long)((tEnd - tNow) % 1000000);
+
+		if (libusb_handle_events_timeout_completed(ctx, &tv, &nArrived) < 0)
+		{
+			break;
+		}
+	}
+
+	libusb_hotplug_deregister_callback(ctx, hArrival);
+
+	return true;
+#else
+	return false;
+#endif
+}
+
+
+EZTRANSPORT EZUsb =
+{
+#ifdef LIBUSB_1
+	"libusb 1.0",
+#else
+	"libusb 0.1",
+#endif
+	UsbOpen,
+	UsbClose,
+	UsbIsOpen,
+	UsbRead,
+	UsbWrite,
+	UsbScan,
+	UsbGetBlock,
+	UsbQueueBlock,
+	UsbFlush,
+	UsbWaitArrival,
+	UsbReopen,
+	UsbLost
+};
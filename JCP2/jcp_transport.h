@@ -0,0 +1,66 @@
+#ifndef __JCP_TRANSPORT_H
+#define __JCP_TRANSPORT_H
+
+/* Access to the EZ-HOST memory, whatever is behind it.
+   All the EZ addresses are in the EZ-HOST memory map (see jcp2.c header),
+   and the transfer functions return the number of bytes moved, or a
+   negative value on failure, like the USB libraries do. */
+
+/* size of a transfer block, data and trailer */
+#define EZ_BLOCKSIZE 4080
+
+typedef struct
+{
+	const char *pszName;
+	bool (*Open)(bool fInstallTurbo);					/* find the board, open it and optionally install turbow */
+	void (*Close)(void);
+	bool (*IsOpen)(void);
+	int  (*Read)(int ez, uchar *buf, int len);			/* read EZ-HOST memory */
+	int  (*Write)(int ez, const uchar *buf, int len);	/* write EZ-HOST memory */
+	int  (*Scan)(int value, const uchar *buf, int len);	/* send scan codes to the EZ-HOST BIOS ($304C) */
+	uchar *(*GetBlock)(void);							/* get a free block to prepare for QueueBlock */
+	bool (*QueueBlock)(int ez, uchar *block);			/* send a block from GetBlock, may return before it is out */
+	bool (*Flush)(void);								/* wait for the queued blocks, false if any failed */
+	bool (*WaitArrival)(int nTimeoutMs);				/* wait for a board to be plugged, false if it can't tell */
+	bool (*Reopen)(void);								/* open the board opened last, with turbow, false if it's not there */
+	bool (*Lost)(void);									/* true if the last failure was the board leaving the bus */
+} EZTRANSPORT;
+
+/* transfer counters, reset by whoever wants to measure something */
+typedef struct
+{
+	unsigned int nReads;
+	unsigned int nWrites;
+	unsigned int nScans;
+	unsigned int nBlocks;							/* blocks sent through QueueBlock */
+	unsigned int nRetries;							/* failed transfers, retried in place */
+	unsigned int nReconnects;						/* the board was lost, and opened again */
+	unsigned int nResent;							/* upload blocks lost, and sent again */
+	unsigned int nBadBlocks;						/* blocks read back corrupted (--check), and sent again */
+	unsigned int nDownMs;							/* spent recovering from both */
+} EZSTATS;
+
+extern EZTRANSPORT EZUsb;			/* libusb 1.0 or 0.1, depending on the build */
+extern EZTRANSPORT EZSim;			/* simulated Skunkboard */
+extern EZTRANSPORT *g_pEZ;			/* transport in use */
+extern int g_SimXferUs;				/* simulated fixed cost per transfer, in microseconds */
+extern int g_SimDropEvery;			/* simulated loss of every so many queued blocks, 0 for none */
+extern EZSTATS g_EZStats;
+
+bool EZInit(void);
+void EZExit(void);
+
+#define EZOpen(f)				g_pEZ->Open(f)
+#define EZClose()				g_pEZ->Close()
+#define EZIsOpen()				g_pEZ->IsOpen()
+#define EZRead(ez, b, l)		(g_EZStats.nReads++, g_pEZ->Read((ez), (uchar*)(b), (l)))
+#define EZWrite(ez, b, l)		(g_EZStats.nWrites++, g_pEZ->Write((ez), (const uchar*)(b), (l)))
+#define EZScan(v, b, l)			(g_EZStats.nScans++, g_pEZ->Scan((v), (const uchar*)(b), (l)))
+#define EZGetBlock()			g_pEZ->GetBlock()
+#define EZQueueBlock(ez, b)		(g_EZStats.nBlocks++, g_pEZ->QueueBlock((ez), (b)))
+#define EZFlush()				g_pEZ->Flush()
+#define EZWaitArrival(t)		g_pEZ->WaitArrival(t)
+#define EZReopen()				g_pEZ->Reopen()
+#define EZLost()				g_pEZ->Lost()
+
+#endif
@@ -0,0 +1,57 @@
+//
+// Decompressor stub (--rle), hand assembled - position independent, loaded
+// along with the compressed image it is followed by, and started there
+//
+// Expands the PackBits like stream after it to dest, then starts the
+// program at entry, with the status register it was started with. A control
+// byte n from 0 to 127 is followed by n+1 bytes to copy, from -1 to -127 by
+// one byte to repeat 1-n times, and -128 ends the stream. The host patches
+// dest and entry at the RLESTUB_xxx offsets, and places the stub and its
+// stream above the expanded image (see jcp_rle.c).
+//
+//  +00  40E7             	move.w	sr,-(sp)
+//  +02  46FC 2700        	move.w	#$2700,sr		; no interrupts
+//  +06  41FA 0036        	lea	stream(pc),a0
+//  +0A  227A 002A        	movea.l	dest(pc),a1
+//  .next:
+//  +0E  1018             	move.b	(a0)+,d0		; control byte
+//  +10  4880             	ext.w	d0
+//  +12  6B08             	bmi.s	.run
+//  .copy:
+//  +14  12D8             	move.b	(a0)+,(a1)+		; n+1 bytes as they are
+//  +16  51C8 FFFC        	dbra	d0,.copy
+//  +1A  60F2             	bra.s	.next
+//  .run:
+//  +1C  B07C FF80        	cmp.w	#-128,d0
+//  +20  670C             	beq.s	.done
+//  +22  4440             	neg.w	d0
+//  +24  1218             	move.b	(a0)+,d1
+//  .repeat:
+//  +26  12C1             	move.b	d1,(a1)+		; 1-n times the same byte
+//  +28  51C8 FFFC        	dbra	d0,.repeat
+//  +2C  60E0             	bra.s	.next
+//  .done:
+//  +2E  46DF             	move.w	(sp)+,sr
+//  +30  207A 0008        	movea.l	entry(pc),a0
+//  +34  4ED0             	jmp	(a0)
+//  dest:
+//  +36  0000 4000        	dc.l	$4000
+//  entry:
+//  +3A  0000 4000        	dc.l	$4000
+//  stream:
+//  +3E
+//
+
+unsigned char RLESTUB[] = {
+	0x40,0xE7,0x46,0xFC,0x27,0x00,0x41,0xFA,0x00,0x36,0x22,0x7A,0x00,0x2A,0x10,0x18,	// @.F.'.A..6"z.*.. //
+	0x48,0x80,0x6B,0x08,0x12,0xD8,0x51,0xC8,0xFF,0xFC,0x60,0xF2,0xB0,0x7C,0xFF,0x80,	// H.k...Q...`..|.. //
+	0x67,0x0C,0x44,0x40,0x12,0x18,0x12,0xC1,0x51,0xC8,0xFF,0xFC,0x60,0xE0,0x46,0xDF,	// g.D@....Q...`.F. //
+	0x20,0x7A,0x00,0x08,0x4E,0xD0,0x00,0x00,0x40,0x00,0x00,0x00,0x40,0x00,          	//  z..N...@...@.   //
+};
+
+// Size of data in above array
+#define SIZE_OF_RLESTUB 62
+
+// Offsets of the parameters in the array, the stream follows it
+#define RLESTUB_DEST		0x36		// long, where the image is expanded
+#define RLESTUB_ENTRY		0x3A		// long, where it is started
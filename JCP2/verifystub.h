@@ -0,0 +1,94 @@
+//
+// Flash checksum stub (--verify), hand assembled - loaded and started at $5000
+//
+// Sums the bank from start to start+length, per 64k flash block, as a sum of
+// the longs and a sum of those sums (Fletcher like, modulo 2^32), and writes
+// the table of both sums to the EZ-HOST at $1800, the table length in bytes
+// in the $1800 length word when it is done. Then it waits for a reset.
+// start and length are multiples of 16, the host patches bank, start and
+// length at the VERIFYSTUB_xxx offsets. About 2 seconds for 4MB.
+//
+//  table	equ	$5100			; 8 bytes a block, after the stub
+//
+//  $5000  46FC 2700       	move.w	#$2700,sr		; no interrupts
+//  $5004  43F9 00C0 0000  	lea	$C00000,a1		; HPI control
+//  $500A  45F9 0080 0000  	lea	$800000,a2		; HPI write data
+//  $5010  32BC 4001       	move.w	#$4001,(a1)		; flash read mode
+//  $5014  32B9 0000 5092  	move.w	bank,(a1)		; $4BA0 bank 1, $4BA1 bank 2
+//  $501A  2079 0000 5096  	movea.l	start,a0
+//  $5020  2E39 0000 509A  	move.l	length,d7		; multiple of 16
+//  $5026  47F9 0000 5100  	lea	table,a3
+//  $502C  7C00            	moveq	#0,d6			; table length
+//  .chunk:
+//  $502E  2A08            	move.l	a0,d5			; up to the next 64k boundary
+//  $5030  0285 0000 FFFF  	andi.l	#$FFFF,d5
+//  $5036  4485            	neg.l	d5
+//  $5038  0685 0001 0000  	addi.l	#$10000,d5
+//  $503E  BA87            	cmp.l	d7,d5
+//  $5040  6302            	bls.s	.last
+//  $5042  2A07            	move.l	d7,d5
+//  .last:
+//  $5044  9E85            	sub.l	d5,d7
+//  $5046  E88D            	lsr.l	#4,d5			; 16 bytes a loop
+//  $5048  5385            	subq.l	#1,d5
+//  $504A  7000            	moveq	#0,d0			; sum of the longs
+//  $504C  7200            	moveq	#0,d1			; sum of the sums
+//  .loop:
+//  $504E  D098            	add.l	(a0)+,d0
+//  $5050  D280            	add.l	d0,d1
+//  $5052  D098            	add.l	(a0)+,d0
+//  $5054  D280            	add.l	d0,d1
+//  $5056  D098            	add.l	(a0)+,d0
+//  $5058  D280            	add.l	d0,d1
+//  $505A  D098            	add.l	(a0)+,d0
+//  $505C  D280            	add.l	d0,d1
+//  $505E  51CD FFEE       	dbra	d5,.loop
+//  $5062  26C0            	move.l	d0,(a3)+
+//  $5064  26C1            	move.l	d1,(a3)+
+//  $5066  5046            	addq.w	#8,d6
+//  $5068  4A87            	tst.l	d7
+//  $506A  66C2            	bne.s	.chunk
+//  $506C  32BC 4004       	move.w	#$4004,(a1)		; HPI write mode
+//  $5070  32BC 1800       	move.w	#$1800,(a1)
+//  $5074  47F9 0000 5100  	lea	table,a3
+//  $507A  3A06            	move.w	d6,d5
+//  $507C  E24D            	lsr.w	#1,d5
+//  $507E  5345            	subq.w	#1,d5
+//  .copy:
+//  $5080  349B            	move.w	(a3)+,(a2)
+//  $5082  51CD FFFC       	dbra	d5,.copy
+//  $5086  32BC 27EA       	move.w	#$27EA,(a1)		; $1800 length word
+//  $508A  3486            	move.w	d6,(a2)			; the table is there
+//  $508C  32BC 4001       	move.w	#$4001,(a1)
+//  .halt:
+//  $5090  60FE            	bra.s	.halt
+//  bank:
+//  $5092  4BA0            	dc.w	$4BA0
+//  $5094  0000            	dc.w	0
+//  start:
+//  $5096  0080 2000       	dc.l	$802000
+//  length:
+//  $509A  0000 0000       	dc.l	0
+//
+
+unsigned char VERIFYSTUB[] = {
+	0x46,0xFC,0x27,0x00,0x43,0xF9,0x00,0xC0,0x00,0x00,0x45,0xF9,0x00,0x80,0x00,0x00,	// F.'.C.....E..... //
+	0x32,0xBC,0x40,0x01,0x32,0xB9,0x00,0x00,0x50,0x92,0x20,0x79,0x00,0x00,0x50,0x96,	// 2.@.2...P. y..P. //
+	0x2E,0x39,0x00,0x00,0x50,0x9A,0x47,0xF9,0x00,0x00,0x51,0x00,0x7C,0x00,0x2A,0x08,	// .9..P.G...Q.|.*. //
+	0x02,0x85,0x00,0x00,0xFF,0xFF,0x44,0x85,0x06,0x85,0x00,0x01,0x00,0x00,0xBA,0x87,	// ......D......... //
+	0x63,0x02,0x2A,0x07,0x9E,0x85,0xE8,0x8D,0x53,0x85,0x70,0x00,0x72,0x00,0xD0,0x98,	// c.*.....S.p.r... //
+	0xD2,0x80,0xD0,0x98,0xD2,0x80,0xD0,0x98,0xD2,0x80,0xD0,0x98,0xD2,0x80,0x51,0xCD,	// ..............Q. //
+	0xFF,0xEE,0x26,0xC0,0x26,0xC1,0x50,0x46,0x4A,0x87,0x66,0xC2,0x32,0xBC,0x40,0x04,	// ..&.&.PFJ.f.2.@. //
+	0x32,0xBC,0x18,0x00,0x47,0xF9,0x00,0x00,0x51,0x00,0x3A,0x06,0xE2,0x4D,0x53,0x45,	// 2...G...Q.:..MSE //
+	0x34,0x9B,0x51,0xCD,0xFF,0xFC,0x32,0xBC,0x27,0xEA,0x34,0x86,0x32,0xBC,0x40,0x01,	// 4.Q...2.'.4.2.@. //
+	0x60,0xFE,0x4B,0xA0,0x00,0x00,0x00,0x80,0x20,0x00,0x00,0x00,0x00,0x00,          	// `.K..... .....   //
+};
+
+// Size of data in above array
+#define SIZE_OF_VERIFYSTUB 158
+
+// Load address, and offsets of the parameters in the array
+#define VERIFYSTUB_BASE		0x5000
+#define VERIFYSTUB_BANK		0x92		// word, $4BA0 bank 1, $4BA1 bank 2
+#define VERIFYSTUB_START	0x96		// long
+#define VERIFYSTUB_LENGTH	0x9A		// long, in bytes